@@ -0,0 +1,205 @@
+/* ansi_vs_native.cpp -- Benchmarks Uncursed's ANSI output backend against the native curses one.
+   Not part of the library itself; a standalone program for measuring the output backends against each other.
+
+MIT License
+
+Copyright (c) 2019 Raine Simmons.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Draws the same scene (a map with things moving around on it, and a message log) with each backend in turn, and reports the bytes sent to the terminal and the time
+   spent in flip() per frame. Each backend runs in a child process on its own pseudo-terminal, so the bytes the terminal actually received can be counted the same way
+   for both; the ANSI backend's own bytes_written figure is shown alongside.
+
+   Building (from this directory, on Linux with NCurses built with wide character support; comment out USING_GURU_MEDITATION and USING_POTLUCK in uncursed.h first
+   if those libraries aren't available):
+
+       g++ -std=c++17 -O2 -I.. ansi_vs_native.cpp ../uncursed.cpp -o ansi_vs_native -lncursesw -lpanelw -lutil -pthread
+
+   Running:
+
+       ./ansi_vs_native [frames] [columns] [rows]
+
+   The defaults are 500 frames on an 80x24 screen.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <poll.h>
+#include <pty.h>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uncursed.h"
+
+
+struct BenchResult
+{
+	bool				ok = false;		// Whether the child process ran to completion and reported its statistics.
+	unsigned long long	pty_bytes = 0;	// Bytes the pseudo-terminal received from the child process, including setting up and shutting down the screen.
+	unc::FrameStats		stats = { };	// The frame statistics reported by the child process.
+};
+
+void		draw_frame(unsigned int frame, std::mt19937 &rng);	// Draws one frame of the benchmark scene.
+BenchResult	run_backend(unc::Backend backend, unsigned int frames, unsigned short cols, unsigned short rows);	// Runs the benchmark scene with a given backend, in a child process on its own pseudo-terminal.
+void		run_child(unc::Backend backend, unsigned int frames, int report_fd);	// The child process side of run_backend(); never returns.
+
+std::shared_ptr<unc::Window>	log_window;	// The message log along the bottom of the screen.
+std::shared_ptr<unc::Window>	map_window;	// The map taking up the rest of the screen.
+
+
+// Draws one frame of the benchmark scene.
+void draw_frame(unsigned int frame, std::mt19937 &rng)
+{
+	const unsigned int map_cols = unc::get_cols(map_window), map_rows = unc::get_rows(map_window);
+	if (!frame)
+	{
+		for (unsigned int y = 0; y < map_rows; y++)
+			for (unsigned int x = 0; x < map_cols; x++)
+				unc::print((x % 9 && y % 5) ? "." : "#", (x % 9 && y % 5) ? unc::Colour::WHITE : unc::Colour::YELLOW, 0, x, y, map_window);
+	}
+
+	// A handful of things move around the map each frame, in assorted colours.
+	const char *things = "@gkoDTZ$!?";
+	for (unsigned int i = 0; i < 40; i++)
+	{
+		const unsigned int x = rng() % map_cols, y = rng() % map_rows;
+		const unc::Colour colour = static_cast<unc::Colour>(1 + rng() % 16);
+		unc::print(std::string(1, things[rng() % 10]), colour, (rng() % 20) ? 0 : UNC_REVERSE, x, y, map_window);
+	}
+
+	// The message log is redrawn from scratch every frame, but most of it is the same as last time.
+	unc::cls(log_window);
+	for (unsigned int i = 0; i < unc::get_rows(log_window); i++)
+	{
+		const unsigned int message = (frame >= i ? frame - i : 0);
+		unc::print("Message " + std::to_string(message / 4) + ": the goblin hits you.", i ? unc::Colour::WHITE : unc::Colour::WHITE_BOLD, 0, 0, i, log_window);
+	}
+	unc::flip();
+}
+
+// Runs the benchmark scene with a given backend, in a child process on its own pseudo-terminal.
+BenchResult run_backend(unc::Backend backend, unsigned int frames, unsigned short cols, unsigned short rows)
+{
+	BenchResult result;
+	int report_pipe[2];
+	if (pipe(report_pipe)) return result;
+
+	struct winsize size = { };
+	size.ws_col = cols;
+	size.ws_row = rows;
+	int master_fd = -1;
+	const pid_t pid = forkpty(&master_fd, nullptr, nullptr, &size);
+	if (pid < 0)
+	{
+		close(report_pipe[0]);
+		close(report_pipe[1]);
+		return result;
+	}
+	if (!pid)
+	{
+		close(report_pipe[0]);
+		run_child(backend, frames, report_pipe[1]);
+	}
+	close(report_pipe[1]);
+
+	// Everything the child sends to its terminal is read and counted here, so it never blocks on a full pseudo-terminal buffer.
+	char buffer[65536];
+	size_t report_received = 0;
+	bool master_open = true, report_open = true;
+	while (master_open || report_open)
+	{
+		struct pollfd fds[2] = { { master_open ? master_fd : -1, POLLIN, 0 }, { report_open ? report_pipe[0] : -1, POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0) break;
+		if (master_open && fds[0].revents)
+		{
+			const ssize_t got = read(master_fd, buffer, sizeof(buffer));
+			if (got > 0) result.pty_bytes += got;
+			else master_open = false;	// Linux reports EIO here once the child has closed its side of the pseudo-terminal.
+		}
+		if (report_open && fds[1].revents)
+		{
+			const ssize_t got = read(report_pipe[0], reinterpret_cast<char*>(&result.stats) + report_received, sizeof(result.stats) - report_received);
+			if (got > 0) report_received += got;
+			else report_open = false;
+		}
+	}
+	close(master_fd);
+	close(report_pipe[0]);
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	result.ok = (report_received == sizeof(result.stats) && WIFEXITED(status) && !WEXITSTATUS(status));
+	return result;
+}
+
+// The child process side of run_backend(); never returns.
+void run_child(unc::Backend backend, unsigned int frames, int report_fd)
+{
+	setenv("TERM", "xterm-256color", 1);	// The same terminal type for both backends, whatever the benchmark itself is running in.
+	unc::init("", backend);
+	map_window = std::make_shared<unc::Window>(unc::get_cols(), unc::get_rows() - 5, 0, 0);
+	log_window = std::make_shared<unc::Window>(unc::get_cols(), 5, 0, unc::get_rows() - 5);
+
+	std::mt19937 rng(12345);
+	unc::reset_frame_stats();
+	for (unsigned int frame = 0; frame < frames; frame++)
+		draw_frame(frame, rng);
+	const unc::FrameStats stats = unc::frame_stats();
+
+	log_window = nullptr;
+	map_window = nullptr;
+	unc::shutdown();
+	const bool sent = (write(report_fd, &stats, sizeof(stats)) == static_cast<ssize_t>(sizeof(stats)));
+	close(report_fd);
+	_exit(sent ? 0 : 1);
+}
+
+int main(int argc, char **argv)
+{
+	const unsigned int frames = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500);
+	const unsigned short cols = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 80), rows = (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 24);
+	if (!frames || cols < 80 || rows < 24)
+	{
+		std::fprintf(stderr, "Usage: %s [frames] [columns] [rows]\nThe screen must be at least 80x24.\n", argv[0]);
+		return 1;
+	}
+
+	const struct { unc::Backend backend; const char *name; } backends[] = { { unc::Backend::NATIVE, "native" }, { unc::Backend::ANSI, "ansi" } };
+	std::printf("%u frames at %ux%u\n\n", frames, cols, rows);
+	std::printf("%-8s %14s %16s %14s %14s %10s\n", "backend", "pty B/frame", "written B/frame", "flip us/frame", "writes/frame", "presented");
+	for (auto &entry : backends)
+	{
+		const BenchResult result = run_backend(entry.backend, frames, cols, rows);
+		if (!result.ok)
+		{
+			std::printf("%-8s (failed to run)\n", entry.name);
+			continue;
+		}
+		const unc::FrameStats &stats = result.stats;
+		const double presented = (stats.frames_presented ? stats.frames_presented : frames);
+		std::printf("%-8s %14.1f %16.1f %14.2f %14.2f %10llu\n", entry.name, result.pty_bytes / static_cast<double>(frames), stats.bytes_written / presented,
+			stats.flip_ns / presented / 1000.0, stats.write_calls / presented, stats.frames_presented);
+	}
+	return 0;
+}
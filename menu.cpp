@@ -39,16 +39,16 @@ namespace unc
 
 
 // Adds an item to this Menu.
-void Menu::add_item(std::string txt, Colour col, std::string sidebox)
+void Menu::add_item(std::string_view txt, Colour col, std::string_view sidebox)
 {
 	stack_trace();
-	items.push_back(txt);
+	items.push_back(std::string(txt));
 	item_x.push_back(0);
 	colour.push_back(col);
-	item_sidebox.push_back(sidebox);
+	item_sidebox.push_back(std::string(sidebox));
 	if (sidebox.size())
 	{
-		const unsigned int height = unc::vector_split(sidebox, MENU_SIDEBOX_WIDTH).size();
+		const unsigned int height = unc::count_lines(sidebox, MENU_SIDEBOX_WIDTH);
 		if (height > sidebox_height) sidebox_height = height;
 	}
 }
@@ -62,11 +62,12 @@ void Menu::reposition()
 	unsigned int widest = 0;
 	for (auto item : items)
 	{
-		const unsigned int len = item.size();
+		const unsigned int len = unc::display_width(item);
 		if (len > widest) widest = len;
 	}
-	if (tag_bl.size() + tag_br.size() > widest) widest = tag_bl.size() + tag_br.size();
-	if (title.size() > widest) widest = title.size();
+	const unsigned int tag_bl_width = unc::display_width(tag_bl), tag_br_width = unc::display_width(tag_br), title_width = unc::display_width(title);
+	if (tag_bl_width + tag_br_width > widest) widest = tag_bl_width + tag_br_width;
+	if (title_width > widest) widest = title_width;
 	x_size = widest + 4;
 	y_size = items.size() + 2;
 	if (y_size > 24) y_size = 24;
@@ -80,11 +81,11 @@ void Menu::reposition()
 	const int window_midcol = unc::get_midcol(window);
 
 	for (unsigned int i = 0; i < item_x.size(); i++)
-		item_x.at(i) = window_midcol - (items.at(i).size() / 2);
+		item_x.at(i) = window_midcol - (unc::display_width(items.at(i)) / 2);
 
-	title_x = window_midcol - (title.size() / 2);
+	title_x = window_midcol - (title_width / 2);
 	bl_x = x_pos + 1;
-	br_x = x_pos + x_size - tag_br.size() - 1;
+	br_x = x_pos + x_size - tag_br_width - 1;
 }
 
 // Renders the menu, returns the chosen menu item (or -1 if none chosen)
@@ -108,17 +109,21 @@ int Menu::render()
 	reposition();
 	while(true)
 	{
-		unc::cls(window);
-		unc::box(window);
-		if (title.size())
+		if (!window->restore_chrome())
 		{
-			unc::move_cursor(title_x - 1, 0, window);
-			unc::print(Glyph::RTEE, Colour::NONE, 0, -1, -1, window);
-			unc::print(title, Colour::CYAN, UNC_BOLD, -1, -1, window);
-			unc::print(Glyph::LTEE, Colour::NONE, 0, -1, -1, window);
+			unc::cls(window);
+			unc::box(window);
+			if (title.size())
+			{
+				unc::move_cursor(title_x - 1, 0, window);
+				unc::print(Glyph::RTEE, Colour::NONE, 0, -1, -1, window);
+				unc::print(title, Colour::CYAN, UNC_BOLD, -1, -1, window);
+				unc::print(Glyph::LTEE, Colour::NONE, 0, -1, -1, window);
+			}
+			if (tag_bl.size()) unc::print(tag_bl, Colour::WHITE, UNC_BOLD, bl_x, window->get_height() - 1, window);
+			if (tag_br.size()) unc::print(tag_br, Colour::WHITE, UNC_BOLD, br_x, window->get_height() - 1, window);
+			window->save_chrome();
 		}
-		if (tag_bl.size()) unc::print(tag_bl, Colour::WHITE, UNC_BOLD, bl_x, window->get_height() - 1, window);
-		if (tag_br.size()) unc::print(tag_br, Colour::WHITE, UNC_BOLD, br_x, window->get_height() - 1, window);
 		const unsigned int start = offset;
 		unsigned int end = items.size();
 		if (end - offset > 22) end = 22 + offset;
@@ -128,13 +133,17 @@ int Menu::render()
 		if (end < items.size()) unc::print(Glyph::DARROW, Colour::GREEN, UNC_BOLD, window->get_width() - 1, window->get_height() - 2, window);
 		if (offset_text)
 		{
-			unc::cls(window_offset);
-			unc::box(window_offset);
+			if (!window_offset->restore_chrome())
+			{
+				unc::cls(window_offset);
+				unc::box(window_offset);
+				window_offset->save_chrome();
+			}
 			if (item_sidebox.at(selected).size())
 			{
-				std::vector<std::string> lines = unc::vector_split(item_sidebox.at(selected), MENU_SIDEBOX_WIDTH);
-				for (unsigned int i = 0; i < lines.size(); i++)
-					unc::print(lines.at(i), Colour::NONE, 0, 2, 1 + i, window_offset);
+				unsigned int line_y = 1;
+				for (auto line : unc::split_lines(item_sidebox.at(selected), MENU_SIDEBOX_WIDTH))
+					unc::print(line, Colour::NONE, 0, 2, line_y++, window_offset);
 			}
 		}
 		unc::flip();
@@ -171,13 +180,13 @@ int Menu::render()
 }
 
 // Sets a title for this menu.
-void Menu::set_title(std::string new_title)
+void Menu::set_title(std::string_view new_title)
 {
 	title = new_title;
 }
 
 // Sets one or both of the bottom tags.
-void Menu::set_tags(std::string bl, std::string br)
+void Menu::set_tags(std::string_view bl, std::string_view br)
 {
 	if (bl.size()) tag_bl = bl;
 	if (br.size()) tag_br = br;
@@ -32,6 +32,7 @@ SOFTWARE.
 #ifdef USE_UNCURSED_MENU
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace unc
@@ -49,10 +50,10 @@ class Menu
 public:
 			Menu() : allow_left(false), allow_right(false), centered_text(true), offset(0), offset_text(false), redraw_on_exit(true), selected(0), sidebox_height(0), window(nullptr), window_offset(nullptr), x_pos(0), y_pos(0),
 				x_size(0), y_size(0), title_x(0), bl_x(0), br_x(0) { }
-	void	add_item(std::string txt, Colour col = static_cast<Colour>(0), std::string sidebox = "");	// Adds an item to this Menu.
+	void	add_item(std::string_view txt, Colour col = static_cast<Colour>(0), std::string_view sidebox = "");	// Adds an item to this Menu.
 	int		render();													// Renders the menu, returns the chosen menu item (or -1 if none chosen)
-	void	set_title(std::string new_title);							// Sets a title for this menu.
-	void	set_tags(std::string bl = "", std::string br = "");			// Sets one or both of the bottom tags.
+	void	set_title(std::string_view new_title);						// Sets a title for this menu.
+	void	set_tags(std::string_view bl = "", std::string_view br = "");	// Sets one or both of the bottom tags.
 	void	allow_left_right(unsigned int flags = 0);					// Allow left and/or right keys as input.
 	void	set_selected(unsigned int pos);								// Sets the currently-selected item.
 	void	no_redraw_on_exit() { redraw_on_exit = false; }				// Disables redraw on exit.
@@ -24,10 +24,45 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <clocale>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
 #include <curses.h>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <list>
+#include <mutex>
 #include <panel.h>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UNC_SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UNC_SIMD_AVX2	// AVX2 is only compiled in where the compiler can target it per-function and check for it at runtime.
+#include <immintrin.h>
+#endif
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(NCURSES_VERSION) && NCURSES_WIDECHAR
+#define UNC_DIRECT_OUTPUT	// The ANSI and headless backends take over from curses' own output and read the screen it composes, which needs NCurses with wide character support.
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
 #include "uncursed.h"
 
 #ifdef USING_GURU_MEDITATION
@@ -35,17 +70,1273 @@ SOFTWARE.
 #endif
 #ifdef USING_POTLUCK
 #include "potluck/potluck.h"
-#else
-#include <algorithm>
 #endif
 
 namespace unc
 {
 
+bool			adaptive_quality = false;	// Does the ANSI backend lower its output quality when the terminal can't keep up?
+#if defined(NCURSES_VERSION) && NCURSES_WIDECHAR
+std::vector<cchar_t>	blit_row;	// One row of a blit(), ready to be handed to curses.
+#else
+std::vector<chtype>	blit_row;	// One row of a blit(), ready to be handed to curses.
+#endif
 unsigned int	cursor_state = 1;	// The current state of the cursor.
+Backend			output_backend = Backend::NATIVE;	// Where the screen is sent at flip() time.
+FrameStats		frame_counters = {};	// Statistics gathered at flip() time.
+FrameStats		last_frame_counters = {};	// As frame_counters, but only for the most recently presented frame.
+unsigned long long	last_frame_requests = 0;	// frame_counters.frames_requested as of the last frame presented.
+std::chrono::steady_clock::duration	frame_interval = std::chrono::steady_clock::duration::zero();	// The shortest time allowed between frames, or zero for no limit.
+bool			frame_pending = false;	// Set when flip() has been called, but the frame hasn't been presented yet because of the frame rate limit.
+std::chrono::steady_clock::time_point	last_present;	// When the last frame was presented.
+bool			panels_changed = true;	// Set when Windows are created, destroyed, moved, shown or hidden, or the terminal is resized; the next flip() updates every panel.
+unsigned int	quality = 0;	// The current adaptive quality level, from 0 (full quality) to QUALITY_MAX.
+std::chrono::steady_clock::time_point	quality_calm_since;	// When the terminal was last seen falling behind, or when quality was last raised.
+std::chrono::steady_clock::time_point	quality_changed;	// When the quality level was last lowered.
+std::chrono::steady_clock::duration	quality_interval = std::chrono::steady_clock::duration::zero();	// The frame rate limit imposed by the adaptive quality level, on top of frame_interval.
+bool			row_skipping = false;	// Are unchanged rows skipped at flip() time?
+bool			row_skipping_reset = true;	// Set when Windows are created, moved, shown or hidden, or the terminal is resized; the next flip() passes everything through.
+std::vector<std::pair<unsigned int, std::function<void(unsigned int, unsigned int)>>>	resize_callbacks;	// Functions to call when the screen is resized, with the IDs that were handed out for them.
+unsigned int	resize_callback_next_id = 1;	// The ID the next resize callback will be given.
+unsigned int	screen_cols = 0, screen_rows = 0;	// The size of the screen, updated only when it's resized.
+std::vector<unsigned long long>	stdscr_row_hashes;	// As Window::row_hashes, for the main screen.
+bool			threaded_output = false;	// Does the ANSI backend hand frames to a writer thread, rather than writing them itself?
+
+struct WrapLayout
+{
+	size_t					key;		// The key this layout is stored under in wrap_cache_index.
+	std::vector<Slice>		lines;		// The lines the text breaks into; every line except the last is followed by a line break.
+	unsigned int			start_col;	// The cursor column the text started printing from.
+	std::string				text;		// A copy of the text this layout was built from, to guard against hash collisions.
+	unsigned int			width;		// The width of the Window the text was wrapped to.
+};
+
+#define QUALITY_NO_BLINK	1	// Blinking text is shown steady.
+#define QUALITY_NO_COLOUR	2	// Colours are dropped, though bold, reverse and so on are kept.
+#define QUALITY_LOW_RATE	3	// The frame rate is limited to 10 frames per second.
+#define QUALITY_FOCUS		4	// Only the Window with the cursor in it is updated, at 5 frames per second; the rest of the screen catches up when quality rises again.
+#define QUALITY_MAX			4
+
+#ifdef UNC_DIRECT_OUTPUT
+struct AnsiCell
+{
+	attr_t	attr = 0;	// The cell's attributes, not including colour.
+	wchar_t	ch[CCHARW_MAX] = { L' ' };	// A spacing character followed by any combining characters; all zero if this cell is covered by a wide character to its left.
+	short	pair = 0;	// The cell's colour pair.
+
+	bool	operator==(const AnsiCell &other) const { return attr == other.attr && pair == other.pair && std::equal(ch, ch + CCHARW_MAX, other.ch); }
+};
+
+struct AnsiFrame
+{
+	std::string	data;	// The bytes to send to the terminal.
+	bool		redraw;	// Does this frame clear and redraw the whole terminal?
+};
+
+struct AnsiState
+{
+	attr_t					attr = 0;	// As ansi_attr.
+	bool					cursor_shown = true;	// As ansi_cursor_shown.
+	int						cursor_x = -1, cursor_y = -1;	// As ansi_cursor_x and ansi_cursor_y.
+	std::vector<AnsiCell>	front;		// As ansi_front.
+	short					pair = 0;	// As ansi_pair.
+};
+
+attr_t					ansi_attr = 0;		// The attributes the terminal is currently set to.
+std::vector<AnsiCell>	ansi_back, ansi_front;	// The frame being presented, and what the terminal is currently showing.
+std::vector<AnsiCell>	ansi_degraded;		// The back buffer with colours and/or blink stripped out, when the adaptive quality level calls for it.
+bool					ansi_bce = false;	// Does the terminal erase using the current background colour?
+std::string				ansi_buffer;		// Everything being sent to the terminal for the current frame.
+std::atomic<unsigned long long>	ansi_bytes_written(0), ansi_write_calls(0), ansi_write_ns(0);	// Bytes written to the terminal, write() calls made, and time spent blocked in them; kept apart from frame_counters as the writer thread updates them.
+AnsiState				ansi_committed;		// What the terminal will be showing once the writer thread has sent every frame it has taken so far.
+int						ansi_cols = 0, ansi_rows = 0;	// The size of the front and back buffers.
+bool					ansi_cursor_shown = true;	// Is the terminal's cursor currently visible?
+int						ansi_cursor_x = -1, ansi_cursor_y = -1;	// Where the terminal's cursor is, or -1 if that isn't known.
+short					ansi_pair = 0;		// The colour pair the terminal is currently set to.
+std::vector<cchar_t>	ansi_raw;			// Each row of the screen exactly as curses reported it last time, so rows that haven't changed needn't be read cell by cell again.
+bool					ansi_redraw = true;	// Set when the terminal needs clearing and redrawing from scratch.
+bool					ansi_rep = false;	// Does the terminal support REP (repeat the last character)?
+int						ansi_term_cols = 0, ansi_term_rows = 0;	// The real size of the terminal, as last checked.
+struct termios			ansi_termios;		// The terminal's settings from before init(), restored by shutdown().
+volatile sig_atomic_t	ansi_winch = 0;		// Set by the SIGWINCH handler when the terminal has been resized.
+std::thread				ansi_writer;		// The writer thread, when threaded output is in use.
+std::atomic<AnsiFrame*>	ansi_writer_mailbox(nullptr);	// The newest frame waiting for the writer thread. A frame still here when the next one is ready is taken back and merged into it.
+std::mutex				ansi_writer_mutex;	// Only used to let the writer thread sleep; frames themselves are handed over through ansi_writer_mailbox.
+std::atomic<bool>		ansi_writer_running(false);	// Cleared to tell the writer thread to send anything left in the mailbox and exit.
+std::atomic<unsigned long long>	ansi_writer_last_bytes(0), ansi_writer_last_calls(0), ansi_writer_last_ns(0);	// The write statistics for the last frame the writer thread sent.
+std::atomic<AnsiFrame*>	ansi_writer_spare(nullptr);	// A frame the writer thread has finished with, kept so its buffer can be reused.
+std::condition_variable	ansi_writer_wake;	// Wakes the writer thread when a frame is posted, or when it's time to stop.
+FILE*					curses_input = nullptr;		// The headless backend's input; curses never actually reads from it.
+FILE*					curses_output = nullptr;	// curses writes here instead of to the terminal when the ANSI or headless backend is active.
+SCREEN*					curses_screen = nullptr;	// The curses screen used to compose frames for the ANSI and headless backends.
+#endif
+std::deque<int>			headless_keys;		// Keys waiting to be returned by get_key() and get_string() when the headless backend is active.
+unsigned int			headless_cols = 80, headless_rows = 24;	// The size of the headless backend's screen.
+
+std::unordered_map<std::string_view, Markup>	markup_cache;	// Compiled Markup, kept by markup() for the life of the program. Keys point into markup_sources, so a lookup never has to allocate.
+std::deque<std::string>	markup_sources;	// Copies of the text each Markup in markup_cache was compiled from; being a deque, the strings never move once added.
+std::list<WrapLayout>	wrap_cache;		// Word-wrap layouts cached by print(), most recently used first.
+std::unordered_map<size_t, std::list<WrapLayout>::iterator>	wrap_cache_index;	// Fast lookup into the wrap cache, keyed on text hash, width and starting column.
+unsigned long long		wrap_cache_hits = 0, wrap_cache_misses = 0;	// Wrap cache statistics.
+unsigned int			wrap_cache_max = 0;	// The maximum number of layouts the wrap cache can hold; 0 means the cache is disabled.
+
+const std::vector<Slice>& wrap_layout(std::string_view text, unsigned int width, unsigned int start_col);	// Looks up the word-wrap layout for a string in the wrap cache, building and storing it if it's not already there.
+char32_t	acs_to_unicode(char32_t ch);	// Converts the character in an ACS (alternate character set) cell into the Unicode character it's drawn as.
+void	append_utf8(std::string &str, char32_t cp);	// Appends a Unicode code point to a string, encoded as UTF-8.
+#ifdef UNC_DIRECT_OUTPUT
+void	adapt_quality();				// Raises or lowers the adaptive quality level, depending on how well the terminal is keeping up with output.
+bool	ansi_check_size(bool force = false);	// Checks the real size of the terminal after a SIGWINCH (or when forced), and resizes curses to match.
+void	ansi_move(int x, int y);		// Moves the terminal's cursor, picking whichever of the available ways to get there is shortest.
+void	ansi_present();					// Compares the screen curses has composed against what the terminal is showing, and sends the differences to the terminal.
+void	ansi_read_screen();				// Reads the screen curses has composed into the ANSI back buffer.
+void	ansi_sgr(attr_t attr, short pair);	// Changes the terminal's attributes and colours, sending only what's changed since last time.
+void	ansi_sigwinch(int);				// Handles SIGWINCH while the ANSI backend is active.
+void	ansi_start();					// Puts the terminal into the state the ANSI backend needs.
+void	ansi_stop();					// Puts the terminal back the way ansi_start() found it.
+void	ansi_write(const std::string &data);	// Writes data to the terminal in full, retrying if the write is interrupted or partial.
+void	ansi_writer_loop();				// The writer thread's main loop, which sends frames from the mailbox to the terminal until told to stop.
+void	ansi_writer_start();			// Starts the writer thread.
+void	ansi_writer_stop();				// Stops the writer thread, after it has sent any frame still waiting for it.
+#endif
+size_t	find_separator(const char *str, size_t len, size_t from, const char *sep, size_t sep_len);	// Finds the first occurrence of a separator in a string, at or after a given position.
+unsigned int	glyph_to_acs(unsigned int glyph);	// Converts a unc::Glyph into the matching curses ACS character.
+unsigned long long	hash_row(WINDOW *win, int row);	// Hashes the contents of a single row of a WINDOW.
+bool	iequals(std::string_view first, std::string_view second);	// Compares two strings, ignoring case.
+bool	is_ascii(const char *text, size_t len);	// Checks if a string is entirely 7-bit ASCII.
+bool	parse_markup_tag(std::string_view tag, unsigned long &attr);	// Parses the inside of a markup style tag into curses attributes.
+size_t	prefix_for_width(const char *text, size_t len, unsigned int cols, size_t *next_char = nullptr);	// Finds how many bytes of a UTF-8 string fit into the given number of columns.
+void	present_frame();	// Sends the screen to the terminal.
+void	resize_screen(int rows, int cols);	// Resizes curses, and handles everything else that needs doing when the screen size changes.
+void	set_attr(WINDOW *win, unsigned long attr);	// Sets a WINDOW's attributes, unless it's already set to them.
+void	skip_unchanged_rows(WINDOW *win, std::vector<unsigned long long> &hashes);	// Untouches any rows of a WINDOW that haven't changed since the last flip().
+unsigned long	style_attr(Colour colour, unsigned int flags);	// Converts a Colour and UNC_* flags into curses attributes.
+bool	panel_covered(PANEL *panel);	// Checks whether every cell of a panel is covered by the panels above it.
+bool	touched_rows(WINDOW *win, int &first, int &last);	// Finds the range of rows in a WINDOW that have been touched since it was last refreshed.
+void	update_dirty_panels();	// Passes only the Windows that have been drawn into since the last flip() on to curses, along with anything above them that they'd otherwise cover up.
+void	update_occlusion(int area_x, int area_y, int area_w, int area_h);	// Works out again whether each visible Window overlapping an area of the screen is completely covered.
+unsigned int	utf8_width(const char *text, size_t len);	// Measures the display width of a UTF-8 string, in columns.
+std::vector<Window*>&	windows();	// Every Window that currently exists.
+
+
+#ifdef UNC_SIMD_SSE2
+// Returns the index of the lowest set bit in a non-zero mask.
+inline unsigned int lowest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Finds the first occurrence of a separator in a string, one byte at a time. Used directly when SIMD isn't available, and to finish off the tail of a string otherwise.
+size_t find_separator_scalar(const char *str, size_t len, size_t from, const char *sep, size_t sep_len)
+{
+	if (sep_len > len) return std::string::npos;
+	const size_t last = len - sep_len;	// The last position a separator could start at.
+	for (size_t i = from; i <= last; i++)
+		if (str[i] == sep[0] && !memcmp(str + i + 1, sep + 1, sep_len - 1)) return i;
+	return std::string::npos;
+}
+
+#ifdef UNC_SIMD_SSE2
+// As above, but checks 16 candidate positions at a time, by matching both the first and last characters of the separator.
+size_t find_separator_sse2(const char *str, size_t len, size_t from, const char *sep, size_t sep_len)
+{
+	if (sep_len > len) return std::string::npos;
+	const size_t last = len - sep_len;
+	const __m128i first_char = _mm_set1_epi8(sep[0]), last_char = _mm_set1_epi8(sep[sep_len - 1]);
+	size_t i = from;
+	for (; i + 16 <= last + 1; i += 16)
+	{
+		const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+		const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i + sep_len - 1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first_char), _mm_cmpeq_epi8(block_last, last_char)));
+		while (mask)
+		{
+			const unsigned int bit = unc::lowest_bit(mask);
+			if (sep_len <= 2 || !memcmp(str + i + bit + 1, sep + 1, sep_len - 2)) return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	return unc::find_separator_scalar(str, len, i, sep, sep_len);
+}
+#endif
+
+#ifdef UNC_SIMD_AVX2
+// As above, with 32 candidate positions at a time.
+__attribute__((target("avx2"))) size_t find_separator_avx2(const char *str, size_t len, size_t from, const char *sep, size_t sep_len)
+{
+	if (sep_len > len) return std::string::npos;
+	const size_t last = len - sep_len;
+	const __m256i first_char = _mm256_set1_epi8(sep[0]), last_char = _mm256_set1_epi8(sep[sep_len - 1]);
+	size_t i = from;
+	for (; i + 32 <= last + 1; i += 32)
+	{
+		const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+		const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i + sep_len - 1));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first_char), _mm256_cmpeq_epi8(block_last, last_char)));
+		while (mask)
+		{
+			const unsigned int bit = unc::lowest_bit(mask);
+			if (sep_len <= 2 || !memcmp(str + i + bit + 1, sep + 1, sep_len - 2)) return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	return unc::find_separator_sse2(str, len, i, sep, sep_len);
+}
+#endif
+
+// Finds the first occurrence of a separator in a string, at or after a given position, using the fastest search the CPU supports.
+size_t find_separator(const char *str, size_t len, size_t from, const char *sep, size_t sep_len)
+{
+	typedef size_t (*FindFunc)(const char*, size_t, size_t, const char*, size_t);
+	static const FindFunc find_func = []() -> FindFunc {
+#ifdef UNC_SIMD_AVX2
+		if (__builtin_cpu_supports("avx2")) return unc::find_separator_avx2;
+#endif
+#ifdef UNC_SIMD_SSE2
+		return unc::find_separator_sse2;
+#else
+		return unc::find_separator_scalar;
+#endif
+	}();
+	return find_func(str, len, from, sep, sep_len);
+}
+
+// Code point ranges which don't take up the usual single column on the terminal: combining marks and other zero-width characters, and East Asian wide/fullwidth characters.
+// Anything not listed here (including all of 7-bit ASCII) is one column wide.
+struct WidthRange
+{
+	char32_t		first, last;	// The first and last code points in this range.
+	unsigned char	width;			// The display width of every code point in the range.
+};
+
+constexpr WidthRange width_table[] = {
+	{ 0x0300, 0x036F, 0 }, { 0x0483, 0x0489, 0 }, { 0x0591, 0x05BD, 0 }, { 0x05BF, 0x05BF, 0 }, { 0x05C1, 0x05C2, 0 }, { 0x05C4, 0x05C5, 0 }, { 0x05C7, 0x05C7, 0 },
+	{ 0x0610, 0x061A, 0 }, { 0x064B, 0x065F, 0 }, { 0x0670, 0x0670, 0 }, { 0x06D6, 0x06DC, 0 }, { 0x06DF, 0x06E4, 0 }, { 0x06E7, 0x06E8, 0 }, { 0x06EA, 0x06ED, 0 },
+	{ 0x0711, 0x0711, 0 }, { 0x0730, 0x074A, 0 }, { 0x07A6, 0x07B0, 0 }, { 0x0900, 0x0902, 0 }, { 0x093A, 0x093A, 0 }, { 0x093C, 0x093C, 0 }, { 0x0941, 0x0948, 0 },
+	{ 0x094D, 0x094D, 0 }, { 0x0951, 0x0957, 0 }, { 0x0962, 0x0963, 0 }, { 0x0E31, 0x0E31, 0 }, { 0x0E34, 0x0E3A, 0 }, { 0x0E47, 0x0E4E, 0 }, { 0x1100, 0x115F, 2 },
+	{ 0x1AB0, 0x1AFF, 0 }, { 0x1DC0, 0x1DFF, 0 }, { 0x200B, 0x200F, 0 }, { 0x202A, 0x202E, 0 }, { 0x2060, 0x2064, 0 }, { 0x20D0, 0x20FF, 0 }, { 0x231A, 0x231B, 2 },
+	{ 0x2329, 0x232A, 2 }, { 0x23E9, 0x23EC, 2 }, { 0x23F0, 0x23F0, 2 }, { 0x23F3, 0x23F3, 2 }, { 0x25FD, 0x25FE, 2 }, { 0x2614, 0x2615, 2 }, { 0x2648, 0x2653, 2 },
+	{ 0x267F, 0x267F, 2 }, { 0x2693, 0x2693, 2 }, { 0x26A1, 0x26A1, 2 }, { 0x26AA, 0x26AB, 2 }, { 0x26BD, 0x26BE, 2 }, { 0x26C4, 0x26C5, 2 }, { 0x26CE, 0x26CE, 2 },
+	{ 0x26D4, 0x26D4, 2 }, { 0x26EA, 0x26EA, 2 }, { 0x26F2, 0x26F3, 2 }, { 0x26F5, 0x26F5, 2 }, { 0x26FA, 0x26FA, 2 }, { 0x26FD, 0x26FD, 2 }, { 0x2705, 0x2705, 2 },
+	{ 0x270A, 0x270B, 2 }, { 0x2728, 0x2728, 2 }, { 0x274C, 0x274C, 2 }, { 0x274E, 0x274E, 2 }, { 0x2753, 0x2755, 2 }, { 0x2757, 0x2757, 2 }, { 0x2795, 0x2797, 2 },
+	{ 0x27B0, 0x27B0, 2 }, { 0x27BF, 0x27BF, 2 }, { 0x2B1B, 0x2B1C, 2 }, { 0x2B50, 0x2B50, 2 }, { 0x2B55, 0x2B55, 2 }, { 0x2E80, 0x303E, 2 }, { 0x3041, 0x33FF, 2 },
+	{ 0x3400, 0x4DBF, 2 }, { 0x4E00, 0x9FFF, 2 }, { 0xA000, 0xA4CF, 2 }, { 0xA960, 0xA97F, 2 }, { 0xAC00, 0xD7A3, 2 }, { 0xF900, 0xFAFF, 2 }, { 0xFE00, 0xFE0F, 0 },
+	{ 0xFE10, 0xFE19, 2 }, { 0xFE20, 0xFE2F, 0 }, { 0xFE30, 0xFE6F, 2 }, { 0xFEFF, 0xFEFF, 0 }, { 0xFF00, 0xFF60, 2 }, { 0xFFE0, 0xFFE6, 2 }, { 0x16FE0, 0x16FE4, 2 },
+	{ 0x17000, 0x18AFF, 2 }, { 0x1B000, 0x1B2FF, 2 }, { 0x1F004, 0x1F004, 2 }, { 0x1F0CF, 0x1F0CF, 2 }, { 0x1F18E, 0x1F18E, 2 }, { 0x1F191, 0x1F19A, 2 },
+	{ 0x1F200, 0x1F202, 2 }, { 0x1F210, 0x1F23B, 2 }, { 0x1F240, 0x1F248, 2 }, { 0x1F250, 0x1F251, 2 }, { 0x1F260, 0x1F265, 2 }, { 0x1F300, 0x1F320, 2 },
+	{ 0x1F32D, 0x1F335, 2 }, { 0x1F337, 0x1F37C, 2 }, { 0x1F37E, 0x1F393, 2 }, { 0x1F3A0, 0x1F3CA, 2 }, { 0x1F3CF, 0x1F3D3, 2 }, { 0x1F3E0, 0x1F3F0, 2 },
+	{ 0x1F3F4, 0x1F3F4, 2 }, { 0x1F3F8, 0x1F43E, 2 }, { 0x1F440, 0x1F440, 2 }, { 0x1F442, 0x1F4FC, 2 }, { 0x1F4FF, 0x1F53D, 2 }, { 0x1F54B, 0x1F54E, 2 },
+	{ 0x1F550, 0x1F567, 2 }, { 0x1F57A, 0x1F57A, 2 }, { 0x1F595, 0x1F596, 2 }, { 0x1F5A4, 0x1F5A4, 2 }, { 0x1F5FB, 0x1F64F, 2 }, { 0x1F680, 0x1F6C5, 2 },
+	{ 0x1F6CC, 0x1F6CC, 2 }, { 0x1F6D0, 0x1F6D2, 2 }, { 0x1F6D5, 0x1F6D7, 2 }, { 0x1F6EB, 0x1F6EC, 2 }, { 0x1F6F4, 0x1F6FC, 2 }, { 0x1F7E0, 0x1F7EB, 2 },
+	{ 0x1F90C, 0x1F93A, 2 }, { 0x1F93C, 0x1F945, 2 }, { 0x1F947, 0x1F9FF, 2 }, { 0x1FA70, 0x1FAFF, 2 }, { 0x20000, 0x2FFFD, 2 }, { 0x30000, 0x3FFFD, 2 },
+	{ 0xE0100, 0xE01EF, 0 } };
+
+// Checks at compile time that the width table is sorted and has no overlapping ranges, as codepoint_width() relies on that for its binary search.
+constexpr bool width_table_sorted()
+{
+	for (size_t i = 0; i < sizeof(width_table) / sizeof(width_table[0]); i++)
+	{
+		if (width_table[i].first > width_table[i].last) return false;
+		if (i && width_table[i].first <= width_table[i - 1].last) return false;
+	}
+	return true;
+}
+static_assert(width_table_sorted(), "width_table must be sorted, with no overlapping ranges.");
+
+// Returns the display width of a single Unicode code point.
+unsigned int codepoint_width(char32_t cp)
+{
+	if (cp < width_table[0].first) return 1;
+	size_t low = 0, high = sizeof(width_table) / sizeof(width_table[0]);
+	while (low < high)
+	{
+		const size_t mid = (low + high) / 2;
+		if (cp > width_table[mid].last) low = mid + 1;
+		else if (cp < width_table[mid].first) high = mid;
+		else return width_table[mid].width;
+	}
+	return 1;
+}
+
+// Decodes a single UTF-8 code point, advancing pos past it. Malformed or truncated sequences are returned one byte at a time, as U+FFFD.
+char32_t decode_utf8(const char *text, size_t len, size_t &pos)
+{
+	const unsigned char lead = text[pos];
+	if (lead < 0x80)
+	{
+		pos++;
+		return lead;
+	}
+	unsigned int extra = 0;	// The number of continuation bytes that should follow the lead byte.
+	if (lead >= 0xC2 && lead <= 0xDF) extra = 1;
+	else if (lead >= 0xE0 && lead <= 0xEF) extra = 2;
+	else if (lead >= 0xF0 && lead <= 0xF4) extra = 3;
+	char32_t cp = lead & (0x3F >> extra);
+	if (!extra || pos + extra >= len)
+	{
+		pos++;
+		return 0xFFFD;
+	}
+	for (unsigned int i = 1; i <= extra; i++)
+	{
+		const unsigned char next = text[pos + i];
+		if ((next & 0xC0) != 0x80)
+		{
+			pos++;
+			return 0xFFFD;
+		}
+		cp = (cp << 6) | (next & 0x3F);
+	}
+	pos += extra + 1;
+	return cp;
+}
+
+// Converts the character in an ACS (alternate character set) cell into the Unicode character it's drawn as.
+char32_t acs_to_unicode(char32_t ch)
+{
+	switch(ch)
+	{
+		case 'j': return 0x2518;
+		case 'k': return 0x2510;
+		case 'l': return 0x250C;
+		case 'm': return 0x2514;
+		case 'n': return 0x253C;
+		case 'q': return 0x2500;
+		case 't': return 0x251C;
+		case 'u': return 0x2524;
+		case 'v': return 0x2534;
+		case 'w': return 0x252C;
+		case 'x': return 0x2502;
+		case '`': return 0x25C6;
+		case 'a': return 0x2592;
+		case 'f': return 0x00B0;
+		case 'g': return 0x00B1;
+		case '~': return 0x00B7;
+		case ',': return 0x2190;
+		case '+': return 0x2192;
+		case '.': return 0x2193;
+		case '-': return 0x2191;
+		case 'h': return 0x2591;
+		case 'i': return 0x2603;
+		case '0': return 0x2588;
+		case 'o': return 0x23BA;
+		case 'p': return 0x23BB;
+		case 'r': return 0x23BC;
+		case 's': return 0x23BD;
+		case 'y': return 0x2264;
+		case 'z': return 0x2265;
+		case '{': return 0x03C0;
+		case '|': return 0x2260;
+		case '}': return 0x00A3;
+		default: return ch;
+	}
+}
+
+// Appends a Unicode code point to a string, encoded as UTF-8.
+void append_utf8(std::string &str, char32_t cp)
+{
+	if (cp < 0x80) str += static_cast<char>(cp);
+	else if (cp < 0x800)
+	{
+		str += static_cast<char>(0xC0 | (cp >> 6));
+		str += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else if (cp < 0x10000)
+	{
+		str += static_cast<char>(0xE0 | (cp >> 12));
+		str += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		str += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else
+	{
+		str += static_cast<char>(0xF0 | (cp >> 18));
+		str += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+		str += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		str += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+#ifdef UNC_DIRECT_OUTPUT
+// Raises or lowers the adaptive quality level, depending on how well the terminal is keeping up with output. Quality drops a step at a time while frames take a long time to write, bytes are
+// left queued for the terminal, or the writer thread has to collapse frames; it rises again a step at a time once the terminal has kept up for a full second.
+void adapt_quality()
+{
+	const auto now = std::chrono::steady_clock::now();
+	int pending = 0;
+#ifdef TIOCOUTQ
+	if (ioctl(STDOUT_FILENO, TIOCOUTQ, &pending) < 0) pending = 0;
+#endif
+	const bool behind = (last_frame_counters.write_ns >= 20000000 || pending >= 32768 || last_frame_counters.frames_collapsed);
+	if (behind)
+	{
+		quality_calm_since = now;
+		if (quality < QUALITY_MAX && now - quality_changed >= std::chrono::milliseconds(250))
+		{
+			quality++;
+			quality_changed = now;
+			frame_counters.quality_changes++;
+		}
+	}
+	else if (quality && now - quality_calm_since >= std::chrono::seconds(1))
+	{
+		quality--;
+		quality_calm_since = now;
+		frame_counters.quality_changes++;
+	}
+
+	if (quality >= QUALITY_FOCUS) quality_interval = std::chrono::milliseconds(200);
+	else if (quality >= QUALITY_LOW_RATE) quality_interval = std::chrono::milliseconds(100);
+	else quality_interval = std::chrono::steady_clock::duration::zero();
+}
+
+// Checks the real size of the terminal after a SIGWINCH (or when forced), and resizes curses to match. Returns true if the size changed.
+bool ansi_check_size(bool force)
+{
+	if (!ansi_winch && !force) return false;
+	ansi_winch = 0;
+	struct winsize size;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) < 0 || !size.ws_col || !size.ws_row) return false;
+	if (size.ws_col == ansi_term_cols && size.ws_row == ansi_term_rows) return false;
+	ansi_term_cols = size.ws_col;
+	ansi_term_rows = size.ws_row;
+	ansi_redraw = true;
+	unc::resize_screen(ansi_term_rows, ansi_term_cols);
+	return true;
+}
+
+// Moves the terminal's cursor, picking whichever of the available ways to get there is shortest.
+void ansi_move(int x, int y)
+{
+	if (x == ansi_cursor_x && y == ansi_cursor_y) return;
+	std::string best = "\x1b[H";
+	if (x) best = "\x1b[" + std::to_string(y + 1) + ";" + std::to_string(x + 1) + "H";
+	else if (y) best = "\x1b[" + std::to_string(y + 1) + "H";
+
+	std::string relative;
+	if (y == ansi_cursor_y && !x) relative = "\r";
+	else if (y == ansi_cursor_y + 1 && ansi_cursor_y >= 0 && !x) relative = "\r\n";
+	else if (y == ansi_cursor_y && ansi_cursor_x >= 0 && x > ansi_cursor_x)
+	{
+		const int gap = x - ansi_cursor_x;
+		relative = (gap == 1 ? "\x1b[C" : "\x1b[" + std::to_string(gap) + "C");
+
+		// Over a short gap, reprinting the unchanged characters is cheaper still, as long as they're plain ASCII in the current attributes.
+		if (gap < 4)
+		{
+			std::string reprint;
+			for (int i = ansi_cursor_x; i < x; i++)
+			{
+				const AnsiCell &cell = ansi_back.at(y * ansi_cols + i);
+				if (cell.attr != ansi_attr || cell.pair != ansi_pair || cell.ch[0] < 0x20 || cell.ch[0] >= 0x7F || cell.ch[1]) break;
+				reprint += static_cast<char>(cell.ch[0]);
+			}
+			if (reprint.size() == static_cast<size_t>(gap)) relative = reprint;
+		}
+	}
+	else if (y == ansi_cursor_y && ansi_cursor_x >= 0 && x < ansi_cursor_x)
+	{
+		const int gap = ansi_cursor_x - x;
+		relative = (gap == 1 ? "\b" : "\x1b[" + std::to_string(gap) + "D");
+	}
+	if (relative.size() && relative.size() < best.size()) best = relative;
+	ansi_buffer += best;
+	ansi_cursor_x = x;
+	ansi_cursor_y = y;
+}
+
+// Compares the screen curses has composed against what the terminal is showing, and sends the differences to the terminal.
+void ansi_present()
+{
+	AnsiFrame *frame = nullptr;
+	if (ansi_writer_running)
+	{
+		frame = ansi_writer_mailbox.exchange(nullptr);
+		if (frame)
+		{
+			// The writer thread hasn't got to the last frame yet, so take it back and build this frame against what the terminal was sent before it instead; anything that frame changed and
+			// this one changes again is only sent once. If that frame was a redraw, this one has to be as well.
+			if (frame->redraw) ansi_redraw = true;
+			else
+			{
+				ansi_front = ansi_committed.front;
+				ansi_attr = ansi_committed.attr;
+				ansi_cursor_x = ansi_committed.cursor_x;
+				ansi_cursor_y = ansi_committed.cursor_y;
+				ansi_pair = ansi_committed.pair;
+			}
+			ansi_cursor_shown = ansi_committed.cursor_shown;
+			frame_counters.frames_collapsed++;
+		}
+		else
+		{
+			ansi_committed.front = ansi_front;
+			ansi_committed.attr = ansi_attr;
+			ansi_committed.cursor_shown = ansi_cursor_shown;
+			ansi_committed.cursor_x = ansi_cursor_x;
+			ansi_committed.cursor_y = ansi_cursor_y;
+			ansi_committed.pair = ansi_pair;
+			frame = ansi_writer_spare.exchange(nullptr);
+			if (!frame) frame = new AnsiFrame();
+		}
+	}
+
+	const int cols = getmaxx(newscr), rows = getmaxy(newscr);
+	const int cursor_x = getcurx(newscr), cursor_y = getcury(newscr);
+	if (cols != ansi_cols || rows != ansi_rows)
+	{
+		ansi_cols = cols;
+		ansi_rows = rows;
+		ansi_back.assign(cols * rows, AnsiCell());
+		ansi_front.assign(cols * rows, AnsiCell());
+		ansi_raw.assign((cols + 1) * rows, cchar_t());
+		ansi_buffer.reserve(cols * rows * 16);	// Enough for a full redraw with a colour change on most cells, so frames are built without reallocating.
+		ansi_redraw = true;
+	}
+	unc::ansi_read_screen();
+
+	ansi_buffer.clear();
+	const bool redraw = ansi_redraw;
+	if (ansi_redraw)
+	{
+		ansi_buffer += "\x1b[0m\x1b(B\x1b[H\x1b[2J";
+		ansi_attr = 0;
+		ansi_pair = 0;
+		ansi_cursor_x = ansi_cursor_y = 0;
+		std::fill(ansi_front.begin(), ansi_front.end(), AnsiCell());
+		ansi_redraw = false;
+	}
+
+	// Under heavy output pressure, only the Window with the cursor in it is updated; panels are checked from the top down, so where Windows overlap it's the one in front.
+	int focus_x = 0, focus_y = 0, focus_w = cols, focus_h = rows;
+	if (quality >= QUALITY_FOCUS && !redraw && cursor_state && cursor_x >= 0 && cursor_y >= 0)
+	{
+		for (PANEL *panel = panel_below(nullptr); panel; panel = panel_below(panel))
+		{
+			if (panel_hidden(panel)) continue;
+			WINDOW *win = panel_window(panel);
+			const int win_x = getbegx(win), win_y = getbegy(win), win_w = getmaxx(win), win_h = getmaxy(win);
+			if (cursor_x < win_x || cursor_y < win_y || cursor_x >= win_x + win_w || cursor_y >= win_y + win_h) continue;
+			focus_x = win_x;
+			focus_y = win_y;
+			focus_w = std::min(win_w, cols - win_x);
+			focus_h = std::min(win_h, rows - win_y);
+			break;
+		}
+	}
+
+	const AnsiCell *source = ansi_back.data();
+	if (quality >= QUALITY_NO_BLINK)
+	{
+		ansi_degraded = ansi_back;
+		for (auto &cell : ansi_degraded)
+		{
+			cell.attr &= ~A_BLINK;
+			if (quality >= QUALITY_NO_COLOUR) cell.pair = 0;
+		}
+		source = ansi_degraded.data();
+	}
+
+	for (int y = focus_y; y < focus_y + focus_h; y++)
+	{
+		const AnsiCell *back = source + y * cols;
+		AnsiCell *front = &ansi_front.at(y * cols);
+		for (int x = focus_x; x < focus_x + focus_w;)
+		{
+			if (!back[x].ch[0] || back[x] == front[x])
+			{
+				x++;
+				continue;
+			}
+			if (x == focus_x && x > 0 && !front[x].ch[0]) front[x - 1].pair = -1;	// This cell is about to overwrite the right half of a wide character outside the focus area; make sure it's redrawn later.
+			if (ansi_cursor_shown)
+			{
+				ansi_buffer += "\x1b[?25l";
+				ansi_cursor_shown = false;
+			}
+			const AnsiCell &cell = back[x];
+			unc::ansi_move(x, y);
+			unc::ansi_sgr(cell.attr, cell.pair);
+
+			// Count how many identical cells follow this one; long enough runs can be sent as a single erase or repeat.
+			const bool wide = (x + 1 < cols && !back[x + 1].ch[0]);
+			int run = 1;
+			if (!wide && !cell.ch[1])
+				while (x + run < focus_x + focus_w && back[x + run] == cell) run++;
+			const bool blank = (cell.ch[0] == L' ' && !(cell.attr & (A_REVERSE | A_UNDERLINE | A_ALTCHARSET)) && (!cell.pair || ansi_bce));
+
+			if (blank && x + run == cols && run >= 4) ansi_buffer += "\x1b[K";
+			else if (blank && run >= 10) ansi_buffer += "\x1b[" + std::to_string(run) + "X";
+			else
+			{
+				if (!ansi_rep || run < 8) run = 1;
+				for (int i = 0; i < CCHARW_MAX && cell.ch[i]; i++)
+					unc::append_utf8(ansi_buffer, cell.ch[i]);
+				if (run > 1) ansi_buffer += "\x1b[" + std::to_string(run - 1) + "b";
+				if (wide) run = 2;
+				ansi_cursor_x += run;
+				if (ansi_cursor_x >= cols) ansi_cursor_x = -1;	// The cursor is waiting to wrap; don't rely on where it is.
+			}
+			std::copy(back + x, back + x + run, front + x);
+			x += run;
+		}
+	}
+
+	if (cursor_state && cursor_x >= 0 && cursor_y >= 0)
+	{
+		unc::ansi_move(cursor_x, cursor_y);
+		if (!ansi_cursor_shown)
+		{
+			ansi_buffer += "\x1b[?25h";
+			ansi_cursor_shown = true;
+		}
+	}
+	else if (!cursor_state && ansi_cursor_shown)
+	{
+		ansi_buffer += "\x1b[?25l";
+		ansi_cursor_shown = false;
+	}
+	if (frame)
+	{
+		frame->data.swap(ansi_buffer);
+		frame->redraw = redraw;
+		ansi_writer_mailbox.store(frame);
+		{ std::lock_guard<std::mutex> lock(ansi_writer_mutex); }
+		ansi_writer_wake.notify_one();
+	}
+	else if (ansi_buffer.size()) unc::ansi_write(ansi_buffer);
+}
+
+// Reads the screen curses has composed into the ANSI back buffer.
+void ansi_read_screen()
+{
+	static std::vector<cchar_t> row_buffer;
+	row_buffer.resize(ansi_cols + 1);
+	for (int y = 0; y < ansi_rows; y++)
+	{
+		std::fill(row_buffer.begin(), row_buffer.end(), cchar_t());
+		mvwin_wchnstr(newscr, y, 0, row_buffer.data(), ansi_cols);
+		cchar_t *raw = &ansi_raw.at(y * (ansi_cols + 1));
+		if (!std::memcmp(raw, row_buffer.data(), row_buffer.size() * sizeof(cchar_t))) continue;
+		std::copy(row_buffer.begin(), row_buffer.end(), raw);
+
+		AnsiCell *row = &ansi_back.at(y * ansi_cols);
+		for (int x = 0; x < ansi_cols; x++)
+		{
+			cchar_t screen_cell;
+			wchar_t chars[CCHARW_MAX + 1] = { };
+			attr_t attr = 0;
+			short pair = 0;
+			mvwin_wch(newscr, y, x, &screen_cell);
+			getcchar(&screen_cell, chars, &attr, &pair, nullptr);
+			AnsiCell &cell = row[x];
+			cell.attr = attr & (A_ALTCHARSET | A_BLINK | A_BOLD | A_DIM | A_REVERSE | A_UNDERLINE);
+			cell.pair = pair;
+			std::copy(chars, chars + CCHARW_MAX, cell.ch);
+			if (!cell.ch[0]) cell.ch[0] = L' ';
+			if (unc::codepoint_width(cell.ch[0]) != 2) continue;
+
+			// A wide character covers the next cell too, which curses reports as a copy of it. That cell is left empty, so it's never drawn by itself. If something has since been
+			// printed over half of the wide character, it can't be shown at all, and becomes a space.
+			wchar_t next_chars[CCHARW_MAX + 1] = { };
+			attr_t next_attr = 0;
+			short next_pair = 0;
+			if (x + 1 < ansi_cols)
+			{
+				mvwin_wch(newscr, y, x + 1, &screen_cell);
+				getcchar(&screen_cell, next_chars, &next_attr, &next_pair, nullptr);
+			}
+			if (x + 1 < ansi_cols && next_attr == attr && next_pair == pair && std::equal(chars, chars + CCHARW_MAX, next_chars))
+			{
+				row[x + 1] = cell;
+				std::fill(row[x + 1].ch, row[x + 1].ch + CCHARW_MAX, 0);
+				x++;
+			}
+			else
+			{
+				std::fill(cell.ch, cell.ch + CCHARW_MAX, 0);
+				cell.ch[0] = L' ';
+			}
+		}
+	}
+}
+
+// Changes the terminal's attributes and colours, sending only what's changed since last time.
+void ansi_sgr(attr_t attr, short pair)
+{
+	if (attr == ansi_attr && pair == ansi_pair) return;
+	if ((attr ^ ansi_attr) & A_ALTCHARSET) ansi_buffer += (attr & A_ALTCHARSET ? "\x1b(0" : "\x1b(B");
+
+	static const struct { attr_t flag; const char *code; } sgr_codes[] = { { A_BOLD, "1" }, { A_DIM, "2" }, { A_UNDERLINE, "4" }, { A_BLINK, "5" }, { A_REVERSE, "7" } };
+	attr_t current = ansi_attr & ~A_ALTCHARSET;
+	short current_pair = ansi_pair;
+	std::string codes;
+	if (current & ~attr)	// Attributes can't be cleared individually everywhere, so any being dropped means starting again from a reset.
+	{
+		codes = "0";
+		current = 0;
+		current_pair = 0;
+	}
+	for (auto code : sgr_codes)
+	{
+		if (!(attr & code.flag) || (current & code.flag)) continue;
+		if (codes.size()) codes += ";";
+		codes += code.code;
+	}
+	if (pair != current_pair)
+	{
+		short fg = -1, bg = -1;
+		if (pair) pair_content(pair, &fg, &bg);
+		if (codes.size()) codes += ";";
+		if (fg < 0) codes += "39";
+		else if (fg < 8) codes += "3" + std::to_string(fg);
+		else codes += "38;5;" + std::to_string(fg);
+		if (bg < 0) codes += ";49";
+		else if (bg < 8) codes += ";4" + std::to_string(bg);
+		else codes += ";48;5;" + std::to_string(bg);
+	}
+	if (codes.size()) ansi_buffer += "\x1b[" + codes + "m";
+	ansi_attr = attr;
+	ansi_pair = pair;
+}
+
+// Handles SIGWINCH while the ANSI backend is active; the actual resize is done later, by ansi_check_size().
+void ansi_sigwinch(int)
+{
+	ansi_winch = 1;
+}
+
+// Puts the terminal into the state the ANSI backend needs: unbuffered input without echo, the alternate screen, and application keypad mode.
+void ansi_start()
+{
+	tcgetattr(STDIN_FILENO, &ansi_termios);
+	struct termios raw = ansi_termios;
+	raw.c_iflag &= ~ICRNL;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+	const char *rep = tigetstr("rep"), *keypad_xmit = tigetstr("smkx");
+	ansi_rep = (rep && rep != reinterpret_cast<char*>(-1));
+	ansi_bce = (tigetflag("bce") > 0);
+	std::string setup = "\x1b[?1049h";
+	if (keypad_xmit && keypad_xmit != reinterpret_cast<char*>(-1)) setup += keypad_xmit;
+	unc::ansi_write(setup);
+	ansi_redraw = true;
+	unc::ansi_check_size(true);
+	if (threaded_output) unc::ansi_writer_start();
+}
+
+// Puts the terminal back the way ansi_start() found it.
+void ansi_stop()
+{
+	unc::ansi_writer_stop();
+	const char *keypad_local = tigetstr("rmkx");
+	std::string restore = "\x1b[0m\x1b(B\x1b[?25h";
+	if (keypad_local && keypad_local != reinterpret_cast<char*>(-1)) restore += keypad_local;
+	restore += "\x1b[?1049l";
+	unc::ansi_write(restore);
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &ansi_termios);
+	ansi_back.clear();
+	ansi_front.clear();
+	ansi_raw.clear();
+	ansi_cols = ansi_rows = ansi_term_cols = ansi_term_rows = 0;
+	ansi_cursor_shown = true;
+	ansi_degraded.clear();
+	quality = 0;
+	quality_interval = std::chrono::steady_clock::duration::zero();
+}
+
+// Writes data to the terminal in full, retrying if the write is interrupted or partial.
+void ansi_write(const std::string &data)
+{
+	const auto start = std::chrono::steady_clock::now();
+	size_t done = 0;
+	while (done < data.size())
+	{
+		const ssize_t result = write(STDOUT_FILENO, data.data() + done, data.size() - done);
+		ansi_write_calls++;
+		if (result < 0)
+		{
+			if (errno == EINTR) continue;
+			return;
+		}
+		done += result;
+	}
+	ansi_bytes_written += data.size();
+	ansi_write_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The writer thread's main loop, which sends frames from the mailbox to the terminal until told to stop.
+void ansi_writer_loop()
+{
+	while (true)
+	{
+		AnsiFrame *frame = ansi_writer_mailbox.exchange(nullptr);
+		if (!frame)
+		{
+			if (!ansi_writer_running) return;
+			std::unique_lock<std::mutex> lock(ansi_writer_mutex);
+			ansi_writer_wake.wait(lock, [] { return ansi_writer_mailbox.load() || !ansi_writer_running; });
+			continue;
+		}
+		const unsigned long long calls = ansi_write_calls, ns = ansi_write_ns;
+		if (frame->data.size()) unc::ansi_write(frame->data);
+		ansi_writer_last_bytes = frame->data.size();
+		ansi_writer_last_calls = ansi_write_calls - calls;
+		ansi_writer_last_ns = ansi_write_ns - ns;
+		delete ansi_writer_spare.exchange(frame);
+	}
+}
+
+// Starts the writer thread.
+void ansi_writer_start()
+{
+	if (ansi_writer_running) return;
+	ansi_writer_running = true;
+	ansi_writer = std::thread(unc::ansi_writer_loop);
+}
+
+// Stops the writer thread, after it has sent any frame still waiting for it.
+void ansi_writer_stop()
+{
+	if (!ansi_writer_running) return;
+	{
+		std::lock_guard<std::mutex> lock(ansi_writer_mutex);
+		ansi_writer_running = false;
+	}
+	ansi_writer_wake.notify_one();
+	ansi_writer.join();
+	delete ansi_writer_spare.exchange(nullptr);
+	ansi_committed.front.clear();
+}
+#endif
+
+// Converts a unc::Glyph into the matching curses ACS character. The ACS characters aren't known until curses has started, so this is always done at the time of printing.
+unsigned int glyph_to_acs(unsigned int glyph)
+{
+	switch(static_cast<unc::Glyph>(glyph))
+	{
+		case unc::Glyph::ULCORNER: return ACS_ULCORNER;
+		case unc::Glyph::LLCORNER: return ACS_LLCORNER;
+		case unc::Glyph::URCORNER: return ACS_URCORNER;
+		case unc::Glyph::LRCORNER: return ACS_LRCORNER;
+		case unc::Glyph::RTEE: return ACS_RTEE;
+		case unc::Glyph::LTEE: return ACS_LTEE;
+		case unc::Glyph::BTEE: return ACS_BTEE;
+		case unc::Glyph::TTEE: return ACS_TTEE;
+		case unc::Glyph::HLINE: return ACS_HLINE;
+		case unc::Glyph::VLINE: return ACS_VLINE;
+		case unc::Glyph::PLUS: return ACS_PLUS;
+		case unc::Glyph::S1: return ACS_S1;
+		case unc::Glyph::S9: return ACS_S9;
+		case unc::Glyph::DIAMOND: return ACS_DIAMOND;
+		case unc::Glyph::CKBOARD: return ACS_CKBOARD;
+		case unc::Glyph::DEGREE: return ACS_DEGREE;
+		case unc::Glyph::PLMINUS: return ACS_PLMINUS;
+		case unc::Glyph::BULLET: return ACS_BULLET;
+		case unc::Glyph::LARROW: return ACS_LARROW;
+		case unc::Glyph::RARROW: return ACS_RARROW;
+		case unc::Glyph::DARROW: return ACS_DARROW;
+		case unc::Glyph::UARROW: return ACS_UARROW;
+		case unc::Glyph::BOARD: return ACS_BOARD;
+		case unc::Glyph::LANTERN: return ACS_LANTERN;
+		case unc::Glyph::BLOCK: return ACS_BLOCK;
+		case unc::Glyph::S3: return ACS_S3;
+		case unc::Glyph::S7: return ACS_S7;
+		case unc::Glyph::LEQUAL: return ACS_LEQUAL;
+		case unc::Glyph::GEQUAL: return ACS_GEQUAL;
+		case unc::Glyph::PI: return ACS_PI;
+		case unc::Glyph::NEQUAL: return ACS_NEQUAL;
+		case unc::Glyph::STERLING: return ACS_STERLING;
+	}
+	return glyph;
+}
+
+// Hashes the contents of a single row of a WINDOW (FNV-1a over the row's characters and attributes).
+unsigned long long hash_row(WINDOW *win, int row)
+{
+	const int cols = getmaxx(win);
+	unsigned long long hash = 14695981039346656037ULL;
+#if defined(NCURSES_VERSION) && NCURSES_WIDECHAR
+	// A chtype only has room for 8 bits of each character, so with wide character support the full cells are hashed instead; otherwise two rows differing only in
+	// characters outside Latin-1 would hash the same, and the second would never be drawn.
+	static std::vector<cchar_t> row_buffer;
+	row_buffer.assign(cols + 1, cchar_t());
+	mvwin_wchnstr(win, row, 0, row_buffer.data(), cols);
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(row_buffer.data());
+	for (size_t i = 0; i < cols * sizeof(cchar_t); i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+#else
+	static std::vector<chtype> row_buffer;
+	row_buffer.resize(cols + 1);
+	mvwinchnstr(win, row, 0, row_buffer.data(), cols);
+	for (int i = 0; i < cols; i++)
+		hash = (hash ^ row_buffer[i]) * 1099511628211ULL;
+#endif
+	return hash;
+}
+
+// Checks if a string contains another, ignoring case.
+bool icontains(std::string_view haystack, std::string_view needle)
+{
+	if (needle.size() > haystack.size()) return false;
+	for (size_t i = 0; i <= haystack.size() - needle.size(); i++)
+		if (unc::iequals(haystack.substr(i, needle.size()), needle)) return true;
+	return false;
+}
+
+// Compares two strings, ignoring case.
+bool iequals(std::string_view first, std::string_view second)
+{
+	if (first.size() != second.size()) return false;
+	for (size_t i = 0; i < first.size(); i++)
+		if (::toupper(static_cast<unsigned char>(first[i])) != ::toupper(static_cast<unsigned char>(second[i]))) return false;
+	return true;
+}
+
+// Checks if a string is entirely 7-bit ASCII, in which case every byte is exactly one column wide.
+bool is_ascii(const char *text, size_t len)
+{
+	size_t i = 0;
+#ifdef UNC_SIMD_SSE2
+	__m128i high_bits = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16)
+		high_bits = _mm_or_si128(high_bits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)));
+	if (_mm_movemask_epi8(high_bits)) return false;
+#endif
+	for (; i < len; i++)
+		if (static_cast<unsigned char>(text[i]) >= 0x80) return false;
+	return true;
+}
+
+// Parses the inside of a markup style tag (such as "Gb" or "/") into curses attributes. Returns false if the tag isn't valid.
+bool parse_markup_tag(std::string_view tag, unsigned long &attr)
+{
+	if (tag == "/")
+	{
+		attr = 0;
+		return true;
+	}
+	if (!tag.size()) return false;
+	Colour colour = Colour::NONE;
+	unsigned int flags = 0;
+	size_t pos = 0;
+	switch (tag[0])
+	{
+		case 'K': colour = Colour::BLACK; break;
+		case 'R': colour = Colour::RED; break;
+		case 'G': colour = Colour::GREEN; break;
+		case 'Y': colour = Colour::YELLOW; break;
+		case 'B': colour = Colour::BLUE; break;
+		case 'M': colour = Colour::MAGENTA; break;
+		case 'C': colour = Colour::CYAN; break;
+		case 'W': colour = Colour::WHITE; break;
+	}
+	if (colour != Colour::NONE) pos++;
+	for (; pos < tag.size(); pos++)
+	{
+		switch (tag[pos])
+		{
+			case 'b': flags |= UNC_BOLD; break;
+			case 'f': flags |= UNC_BLINK; break;
+			case 'r': flags |= UNC_REVERSE; break;
+			default: return false;
+		}
+	}
+	attr = unc::style_attr(colour, flags);
+	return true;
+}
+
+// Finds how many bytes of a UTF-8 string fit into the given number of columns, without splitting a character. If next_char is given, it's set to the length of the character that didn't fit.
+size_t prefix_for_width(const char *text, size_t len, unsigned int cols, size_t *next_char)
+{
+	if (unc::is_ascii(text, len))
+	{
+		if (next_char) *next_char = (cols < len ? 1 : 0);
+		return (cols < len ? cols : len);
+	}
+	size_t pos = 0;
+	unsigned int used = 0;
+	while (pos < len)
+	{
+		size_t next = pos;
+		const unsigned int char_width = unc::codepoint_width(unc::decode_utf8(text, len, next));
+		if (used + char_width > cols)
+		{
+			if (next_char) *next_char = next - pos;
+			return pos;
+		}
+		used += char_width;
+		pos = next;
+	}
+	if (next_char) *next_char = 0;
+	return pos;
+}
+
+// Checks whether every cell of a panel is covered by the panels above it, which are all opaque.
+bool panel_covered(PANEL *panel)
+{
+	struct Area { int x1, y1, x2, y2; };
+	WINDOW *win = panel_window(panel);
+	const int x1 = getbegx(win), y1 = getbegy(win), x2 = x1 + getmaxx(win), y2 = y1 + getmaxy(win);
+	std::vector<Area> above;
+	for (PANEL *other = panel_above(panel); other; other = panel_above(other))
+	{
+		WINDOW *other_win = panel_window(other);
+		const Area area = { getbegx(other_win), getbegy(other_win), getbegx(other_win) + getmaxx(other_win), getbegy(other_win) + getmaxy(other_win) };
+		if (area.x1 < x2 && area.x2 > x1 && area.y1 < y2 && area.y2 > y1) above.push_back(area);
+	}
+	if (!above.size()) return false;
+
+	// Check each row in turn, by sorting the spans of the overlapping panels and looking for a gap between them.
+	std::vector<std::pair<int, int>> spans;
+	for (int row = y1; row < y2; row++)
+	{
+		spans.clear();
+		for (auto &area : above)
+			if (area.y1 <= row && area.y2 > row) spans.push_back(std::make_pair(area.x1, area.x2));
+		std::sort(spans.begin(), spans.end());
+		int covered_to = x1;
+		for (auto &span : spans)
+		{
+			if (span.first > covered_to) break;
+			covered_to = std::max(covered_to, span.second);
+			if (covered_to >= x2) break;
+		}
+		if (covered_to < x2) return false;
+	}
+	return true;
+}
+
+// Sends the screen to the terminal.
+void present_frame()
+{
+	const auto start_time = std::chrono::steady_clock::now();
+	const FrameStats before = unc::frame_stats();
+#ifdef UNC_DIRECT_OUTPUT
+	// Resizes are picked up here as well as in get_key(), so the ANSI backend follows the terminal's size even if nothing is reading input.
+	if (output_backend == Backend::ANSI && unc::ansi_check_size()) ungetch(KEY_RESIZE);
+#endif
+	if (row_skipping)
+	{
+		unc::skip_unchanged_rows(stdscr, stdscr_row_hashes);
+		for (auto window : unc::windows())
+			if (!panel_hidden(window->panel_ptr) && !window->occluded) unc::skip_unchanged_rows(window->win(), window->row_hashes);
+		row_skipping_reset = false;
+	}
+	if (panels_changed)
+	{
+		update_panels();
+		wnoutrefresh(stdscr);
+		for (auto window : unc::windows())
+			if (!panel_hidden(window->panel_ptr)) frame_counters.windows_refreshed++;
+		panels_changed = false;
+	}
+	else unc::update_dirty_panels();
+	if (output_backend == Backend::NATIVE) doupdate();
+#ifdef UNC_DIRECT_OUTPUT
+	if (output_backend == Backend::ANSI) unc::ansi_present();
+#endif
+	frame_pending = false;
+	last_present = std::chrono::steady_clock::now();
+	frame_counters.frames_presented++;
+	frame_counters.flip_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(last_present - start_time).count();
+	if (quality) frame_counters.frames_degraded++;
+
+	const FrameStats after = unc::frame_stats();
+	last_frame_counters.attr_changes_saved = after.attr_changes_saved - before.attr_changes_saved;
+	last_frame_counters.bytes_written = after.bytes_written - before.bytes_written;
+	last_frame_counters.flip_ns = after.flip_ns - before.flip_ns;
+	last_frame_counters.frames_collapsed = after.frames_collapsed - before.frames_collapsed;
+	last_frame_counters.frames_degraded = after.frames_degraded - before.frames_degraded;
+	last_frame_counters.frames_presented = 1;
+	last_frame_counters.frames_requested = after.frames_requested - last_frame_requests;
+	last_frame_requests = after.frames_requested;
+	last_frame_counters.rows_emitted = after.rows_emitted - before.rows_emitted;
+	last_frame_counters.rows_skipped = after.rows_skipped - before.rows_skipped;
+	last_frame_counters.windows_occluded = after.windows_occluded - before.windows_occluded;
+	last_frame_counters.windows_refreshed = after.windows_refreshed - before.windows_refreshed;
+	last_frame_counters.windows_skipped = after.windows_skipped - before.windows_skipped;
+	last_frame_counters.write_calls = after.write_calls - before.write_calls;
+	last_frame_counters.write_ns = after.write_ns - before.write_ns;
+#ifdef UNC_DIRECT_OUTPUT
+	if (ansi_writer_running)
+	{
+		// With threaded output, nothing is written during the frame itself; report the last frame the writer thread actually sent instead.
+		last_frame_counters.bytes_written = ansi_writer_last_bytes;
+		last_frame_counters.write_calls = ansi_writer_last_calls;
+		last_frame_counters.write_ns = ansi_writer_last_ns;
+	}
+	if (adaptive_quality && output_backend == Backend::ANSI) unc::adapt_quality();
+#endif
+	last_frame_counters.quality_changes = frame_counters.quality_changes - before.quality_changes;
+}
 
+// Resizes curses (0, 0 takes the size from the terminal), applies the minimum screen size of 80x24, and updates the cached screen size. Resize callbacks are called if the size has
+// changed. The headless backend has no real terminal to fit, so it's exactly the size asked for, with no minimum. This is the only place the screen size is ever changed.
+void resize_screen(int rows, int cols)
+{
+	resize_term(rows, cols);
+	if (output_backend != Backend::HEADLESS && (getmaxx(stdscr) < 80 || getmaxy(stdscr) < 24)) resize_term(24, 80);
+	curs_set(cursor_state);
+	row_skipping_reset = true;
+	panels_changed = true;
+	const unsigned int new_cols = getmaxx(stdscr), new_rows = getmaxy(stdscr);
+	if (new_cols == screen_cols && new_rows == screen_rows) return;
+	screen_cols = new_cols;
+	screen_rows = new_rows;
+	for (auto window : unc::windows())
+		window->clear_chrome();
+	// Callbacks may add or remove callbacks, so this works from a copy of the list. Any added are left until the next resize, and any removed by an earlier callback are skipped.
+	const auto callbacks = resize_callbacks;
+	for (auto &callback : callbacks)
+	{
+		const unsigned int id = callback.first;
+		if (std::any_of(resize_callbacks.begin(), resize_callbacks.end(), [id](const auto &registered) { return registered.first == id; })) callback.second(screen_cols, screen_rows);
+	}
+}
+
+// Sets a WINDOW's attributes, unless it's already set to them. print() and box() leave their style set on the WINDOW rather than turning it back off afterwards, so consecutive calls
+// in the same style don't need to change anything.
+void set_attr(WINDOW *win, unsigned long attr)
+{
+	if (static_cast<unsigned long>(getattrs(win)) == attr) frame_counters.attr_changes_saved++;
+	else wattrset(win, attr);
+}
+
+// Untouches any rows of a WINDOW that haven't changed since the last flip(), so curses doesn't need to compare them against the screen again.
+void skip_unchanged_rows(WINDOW *win, std::vector<unsigned long long> &hashes)
+{
+	const int rows = getmaxy(win);
+	if (row_skipping_reset || static_cast<int>(hashes.size()) != rows) hashes.assign(rows, 0);
+	const int old_x = getcurx(win), old_y = getcury(win);
+	for (int row = 0; row < rows; row++)
+	{
+		if (!is_linetouched(win, row)) continue;
+		const unsigned long long hash = unc::hash_row(win, row);
+		if (hash == hashes.at(row) && !row_skipping_reset)
+		{
+			wtouchln(win, row, 1, 0);
+			frame_counters.rows_skipped++;
+		}
+		else
+		{
+			hashes.at(row) = hash;
+			frame_counters.rows_emitted++;
+		}
+	}
+	wmove(win, old_y, old_x);
+}
+
+// Converts a Colour and UNC_* flags into curses attributes.
+unsigned long style_attr(Colour colour, unsigned int flags)
+{
+	if (colour >= Colour::BLACK_BOLD && colour <= Colour::WHITE_BOLD)
+	{
+		flags |= UNC_BOLD;
+		colour = static_cast<Colour>(static_cast<int>(colour) - 8);
+	}
+	unsigned long attr = 0;
+	if (colour != Colour::NONE) attr |= COLOR_PAIR(static_cast<unsigned int>(colour));
+	if ((flags & UNC_BOLD) == UNC_BOLD) attr |= A_BOLD;
+	if ((flags & UNC_REVERSE) == UNC_REVERSE) attr |= A_REVERSE;
+	if ((flags & UNC_BLINK) == UNC_BLINK) attr |= A_BLINK;
+	return attr;
+}
+
+// Finds the range of rows in a WINDOW that have been touched since it was last refreshed. Returns false if none have.
+bool touched_rows(WINDOW *win, int &first, int &last)
+{
+	const int rows = getmaxy(win);
+	first = 0;
+	while (first < rows && !is_linetouched(win, first)) first++;
+	if (first == rows) return false;
+	last = rows - 1;
+	while (!is_linetouched(win, last)) last--;
+	return true;
+}
 
-Window::Window(unsigned int width, unsigned int height, int new_x, int new_y, bool new_border) : border_ptr(nullptr)
+// Passes only the Windows that have been drawn into since the last flip() on to curses, along with anything above them that they'd otherwise cover up, rather than update_panels()
+// checking every Window against every other. Windows are taken from the bottom up; any rows of a Window that overlap the changed rows of a Window below it are touched, so it's drawn
+// back over the top.
+void update_dirty_panels()
+{
+	struct DirtyArea { int x1, y1, x2, y2; };
+	std::vector<DirtyArea> dirty;
+	int first, last;
+	if (unc::touched_rows(stdscr, first, last)) dirty.push_back({ 0, first, getmaxx(stdscr) - 1, last });
+	wnoutrefresh(stdscr);
+
+	for (PANEL *panel = panel_above(nullptr); panel; panel = panel_above(panel))
+	{
+		const Window *window = static_cast<const Window*>(panel_userptr(panel));
+		if (window && window->is_occluded())
+		{
+			frame_counters.windows_occluded++;
+			continue;
+		}
+		WINDOW *win = panel_window(panel);
+		const int win_x = getbegx(win), win_y = getbegy(win), win_x2 = win_x + getmaxx(win) - 1, win_y2 = win_y + getmaxy(win) - 1;
+		for (auto &area : dirty)
+		{
+			if (area.x1 > win_x2 || area.x2 < win_x || area.y1 > win_y2 || area.y2 < win_y) continue;
+			const int touch_start = std::max(area.y1, win_y), touch_end = std::min(area.y2, win_y2);
+			touchline(win, touch_start - win_y, touch_end - touch_start + 1);
+		}
+		if (!unc::touched_rows(win, first, last))
+		{
+			frame_counters.windows_skipped++;
+			continue;
+		}
+		dirty.push_back({ win_x, win_y + first, win_x2, win_y + last });
+		wnoutrefresh(win);
+		frame_counters.windows_refreshed++;
+	}
+}
+
+// Works out again whether each visible Window overlapping an area of the screen is completely covered by the Windows above it. Called whenever a Window is created, destroyed,
+// moved, shown, hidden, raised or lowered, with the area that Window covers (or used to), as those are the only Windows whose coverage can have changed.
+void update_occlusion(int area_x, int area_y, int area_w, int area_h)
+{
+	for (auto window : unc::windows())
+	{
+		if (panel_hidden(window->panel_ptr))
+		{
+			window->occluded = false;
+			continue;
+		}
+		if (window->x >= area_x + area_w || window->x + static_cast<int>(window->w) <= area_x || window->y >= area_y + area_h || window->y + static_cast<int>(window->h) <= area_y) continue;
+		window->occluded = unc::panel_covered(window->panel_ptr);
+	}
+}
+
+// Measures the display width of a UTF-8 string, in columns.
+unsigned int utf8_width(const char *text, size_t len)
+{
+	unsigned int width = 0;
+	size_t pos = 0;
+	while (pos < len)
+		width += unc::codepoint_width(unc::decode_utf8(text, len, pos));
+	return width;
+}
+
+// Every Window that currently exists. The list is created the first time it's needed and never destroyed, as a Window held in a global elsewhere may be constructed before
+// this file's globals, or destroyed after them.
+std::vector<Window*>& windows()
+{
+	static std::vector<Window*> *list = new std::vector<Window*>();
+	return *list;
+}
+
+
+Window::Window(unsigned int width, unsigned int height, int new_x, int new_y, bool new_border) : border_ptr(nullptr), chrome_ptr(nullptr), occluded(false)
 {
 	stack_trace();
 	if (new_border)
@@ -62,6 +1353,11 @@ Window::Window(unsigned int width, unsigned int height, int new_x, int new_y, bo
 	y = new_y;
 	window_ptr = newwin(height, width, new_y, new_x);
 	panel_ptr = new_panel(window_ptr);
+	set_panel_userptr(panel_ptr, this);
+	unc::windows().push_back(this);
+	row_skipping_reset = true;
+	panels_changed = true;
+	unc::update_occlusion(x, y, w, h);
 }
 
 Window::~Window()
@@ -69,15 +1365,106 @@ Window::~Window()
 	stack_trace();
 	del_panel(panel_ptr);
 	delwin(window_ptr);
+	if (chrome_ptr) delwin(chrome_ptr);
+	auto registered = std::find(unc::windows().begin(), unc::windows().end(), this);
+	if (registered != unc::windows().end()) unc::windows().erase(registered);
+	row_skipping_reset = true;
+	panels_changed = true;
+	unc::update_occlusion(x, y, w, h);
+}
+
+// Moves this Window beneath all other Windows. Its border, if it has one, goes to the very bottom, just beneath its contents.
+void Window::lower()
+{
+	stack_trace();
+	bottom_panel(panel_ptr);
+	if (border_ptr) border_ptr->lower();
+	row_skipping_reset = true;
+	panels_changed = true;
+	unc::update_occlusion(x, y, w, h);
 }
 
 // Moves this Window's underlying panel to new coordinates.
 void Window::move(int new_x, int new_y)
 {
 	stack_trace();
+	const int old_x = x, old_y = y;
 	x = new_x;
 	y = new_y;
 	move_panel(panel_ptr, y, x);
+	row_skipping_reset = true;
+	panels_changed = true;
+	clear_chrome();
+	unc::update_occlusion(old_x, old_y, w, h);
+	unc::update_occlusion(x, y, w, h);
+}
+
+// Forgets this Window's chrome template, if it has one. This happens automatically when the Window is moved, the screen is resized, or the colours are set up again.
+void Window::clear_chrome()
+{
+	stack_trace();
+	if (!chrome_ptr) return;
+	delwin(chrome_ptr);
+	chrome_ptr = nullptr;
+}
+
+// Copies a rectangle of this Window into another Window (or the main screen) at the given position, clipped to fit both. With overlay set, blank cells are skipped, leaving the
+// destination showing through them.
+void Window::copy_rect(unc::WindowRef dest, int src_x, int src_y, int width, int height, int dest_x, int dest_y, bool overlay) const
+{
+	stack_trace();
+	WINDOW *dest_win = (dest ? dest->win() : stdscr);
+	if (src_x < 0)
+	{
+		dest_x -= src_x;
+		width += src_x;
+		src_x = 0;
+	}
+	if (src_y < 0)
+	{
+		dest_y -= src_y;
+		height += src_y;
+		src_y = 0;
+	}
+	if (dest_x < 0)
+	{
+		src_x -= dest_x;
+		width += dest_x;
+		dest_x = 0;
+	}
+	if (dest_y < 0)
+	{
+		src_y -= dest_y;
+		height += dest_y;
+		dest_y = 0;
+	}
+	width = std::min({ width, static_cast<int>(w) - src_x, getmaxx(dest_win) - dest_x });
+	height = std::min({ height, static_cast<int>(h) - src_y, getmaxy(dest_win) - dest_y });
+	if (width <= 0 || height <= 0) return;
+	copywin(window_ptr, dest_win, src_y, src_x, dest_y, dest_x, dest_y + height - 1, dest_x + width - 1, overlay ? TRUE : FALSE);
+}
+
+// Copies the whole of this Window into another Window (or the main screen) at the given position, clipped to fit. Blank cells are left transparent.
+void Window::overlay_onto(unc::WindowRef dest, int dest_x, int dest_y) const
+{
+	copy_rect(dest, 0, 0, w, h, dest_x, dest_y, true);
+}
+
+// Copies the whole of this Window into another Window (or the main screen) at the given position, clipped to fit. Blank cells are copied too.
+void Window::overwrite_onto(unc::WindowRef dest, int dest_x, int dest_y) const
+{
+	copy_rect(dest, 0, 0, w, h, dest_x, dest_y, false);
+}
+
+// Moves this Window above all other Windows. Its border, if it has one, goes up first, so it ends up just beneath its contents.
+void Window::raise()
+{
+	stack_trace();
+	if (border_ptr) border_ptr->raise();
+	top_panel(panel_ptr);
+	row_skipping_reset = true;
+	panels_changed = true;
+	unc::update_occlusion(x, y, w, h);
 }
 
 // Re-renders the border around this Window, if any.
@@ -89,17 +1476,219 @@ void Window::redraw_border(Colour col)
 #endif
 }
 
-// Set this Window's panel as visible or invisible.
-void Window::set_visible(bool vis)
-{
-	stack_trace();
-	if (vis) show_panel(panel_ptr);
-	else hide_panel(panel_ptr);
-}
-
-
+// Restores this Window's contents from its chrome template with a single block copy, ready for the rest of the Window to be drawn over it. Returns false if there's no template,
+// in which case the chrome needs drawing (and saving with save_chrome()) again.
+bool Window::restore_chrome()
+{
+	stack_trace();
+	if (!chrome_ptr) return false;
+	copywin(chrome_ptr, window_ptr, 0, 0, 0, 0, h - 1, w - 1, FALSE);
+	return true;
+}
+
+// Saves this Window's current contents (border, title, other static decorations) as its chrome template, to be restored by restore_chrome().
+void Window::save_chrome()
+{
+	stack_trace();
+	if (!chrome_ptr) chrome_ptr = newpad(h, w);
+	copywin(window_ptr, chrome_ptr, 0, 0, 0, 0, h - 1, w - 1, FALSE);
+}
+
+// Set this Window's panel as visible or invisible.
+void Window::set_visible(bool vis)
+{
+	stack_trace();
+	if (vis) show_panel(panel_ptr);
+	else hide_panel(panel_ptr);
+	row_skipping_reset = true;
+	panels_changed = true;
+	unc::update_occlusion(x, y, w, h);
+}
+
+// Starts iterating over the lines of a string, split to a given line length.
+LineRange::iterator::iterator(std::string_view new_text, unsigned int new_line_len) : ascii(unc::is_ascii(new_text.data(), new_text.size())), current_cols(0), current_line{0, 0}, done(false), index(0),
+	line_len(new_line_len), text(new_text), word{0, 0}, word_cols(0), word_pending(false), word_start(0), words_done(false)
+{
+	if ((ascii ? text.size() : unc::utf8_width(text.data(), text.size())) <= line_len)
+	{
+		line = text;	// Short strings are always returned as-is, as a single line.
+		words_done = true;
+	}
+	else next();
+}
+
+// Moves on to the next line, following the same rules as vector_split(), but measuring UTF-8 text by display width.
+void LineRange::iterator::next()
+{
+	while (true)
+	{
+		if (!word_pending)
+		{
+			if (words_done)
+			{
+				if (current_line.length)
+				{
+					line = text.substr(current_line.offset, current_line.length);
+					current_line.length = current_cols = 0;
+					index++;
+				}
+				else done = true;
+				return;
+			}
+			size_t word_end = unc::find_separator(text.data(), text.size(), word_start, " ", 1);
+			if (word_end == std::string::npos)
+			{
+				word_end = text.size();
+				words_done = true;
+			}
+			word = {word_start, word_end - word_start};
+			word_cols = (ascii ? word.length : unc::utf8_width(text.data() + word.offset, word.length));
+			word_pending = true;
+			word_start = word_end + 1;
+		}
+
+		// If the word itself is too wide for the line, the part that fits is dealt with as a word of its own, the character after that is dropped, and the rest is dealt with afterwards.
+		Slice part = word;
+		size_t part_cols = word_cols;
+		if (word_cols > line_len)
+		{
+			size_t dropped_len;
+			part.length = unc::prefix_for_width(text.data() + word.offset, word.length, line_len, &dropped_len);
+			word.offset += part.length + dropped_len;
+			word.length -= part.length + dropped_len;
+			word_cols = (ascii ? word.length : unc::utf8_width(text.data() + word.offset, word.length));
+			part_cols = line_len;	// The part always fills its line, even if a wide character left a gap at the end, so the rest of the word can't join it.
+		}
+		else word_pending = false;
+
+		if (current_cols + part_cols + 1 > line_len)
+		{
+			line = text.substr(current_line.offset, current_line.length);
+			current_line = part;
+			current_cols = part_cols;
+			index++;
+			return;
+		}
+		else if (current_line.length)
+		{
+			current_line.length = part.offset + part.length - current_line.offset;
+			current_cols += part_cols + 1;
+		}
+		else
+		{
+			current_line = part;
+			current_cols = part_cols;
+		}
+	}
+}
+
+// Compiles text with inline style tags into plain text and a list of styled runs.
+Markup::Markup(std::string_view source)
+{
+	stack_trace();
+	unsigned long current_attr = 0;
+	size_t pos = 0;
+	while (pos < source.size())
+	{
+		size_t tag_start = source.find('{', pos);
+		if (tag_start == std::string_view::npos) tag_start = source.size();
+		add_text(source.substr(pos, tag_start - pos), current_attr);
+		if (tag_start == source.size()) break;
+
+		pos = tag_start + 1;
+		if (pos < source.size() && source[pos] == '{')
+		{
+			add_text("{", current_attr);	// A doubled brace is a literal brace.
+			pos++;
+			continue;
+		}
+		const size_t tag_end = source.find('}', pos);
+		unsigned long new_attr = 0;
+		if (tag_end != std::string_view::npos && unc::parse_markup_tag(source.substr(pos, tag_end - pos), new_attr))
+		{
+			current_attr = new_attr;
+			pos = tag_end + 1;
+			continue;
+		}
+#ifdef USING_GURU_MEDITATION
+		guru::nonfatal("Invalid markup tag in string: " + std::string(source), GURU_WARN);
+#endif
+		add_text("{", current_attr);	// Invalid tags are printed as-is.
+	}
+}
+
+// Adds plain text to the end of this Markup, in the given style.
+void Markup::add_text(std::string_view text, unsigned long attr)
+{
+	if (!text.size()) return;
+	if (!style_runs.size() || style_runs.back().attr != attr) style_runs.push_back({attr, plain_text.size(), 0});
+	plain_text += text;
+	style_runs.back().length += text.size();
+}
+
+
+// Registers a function to be called with the new width and height whenever the screen is resized. Returns an ID for remove_resize_callback().
+unsigned int add_resize_callback(std::function<void(unsigned int cols, unsigned int rows)> callback)
+{
+	stack_trace();
+	resize_callbacks.push_back(std::make_pair(resize_callback_next_id, callback));
+	return resize_callback_next_id++;
+}
+
+// Draws a block of pre-styled cells, clipped to the Window. Row r of the block starts at cells[r * stride] and is w cells wide; x and y may be negative, or the block may run
+// off the edge of the Window, and only the part that overlaps the Window is drawn. Each row is drawn in a single call, and the cursor is left where it was. With wide character
+// support, any single-column Unicode character can be drawn; otherwise, characters are limited to a single byte.
+void blit(const Cell *cells, size_t cell_count, unsigned int stride, unsigned int w, unsigned int h, int x, int y, unc::WindowRef window)
+{
+	stack_trace();
+	WINDOW *win = (window ? window->win() : stdscr);
+	int src_x = 0, src_y = 0, width = w, height = h;
+	if (x < 0)
+	{
+		src_x = -x;
+		width += x;
+		x = 0;
+	}
+	if (y < 0)
+	{
+		src_y = -y;
+		height += y;
+		y = 0;
+	}
+	width = std::min(width, getmaxx(win) - x);
+	height = std::min(height, getmaxy(win) - y);
+	if (width <= 0 || height <= 0) return;
+
+	const int old_x = getcurx(win), old_y = getcury(win);
+	blit_row.resize(width + 1);
+	for (int row = 0; row < height; row++)
+	{
+		const size_t start = static_cast<size_t>(src_y + row) * stride + src_x;
+		if (start + width > cell_count) break;
+		for (int i = 0; i < width; i++)
+		{
+			const Cell &cell = cells[start + i];
+#if defined(NCURSES_VERSION) && NCURSES_WIDECHAR
+			// An ACS character is a byte with A_ALTCHARSET set, which goes into the cchar_t the same way mvwaddchnstr() would have put it there.
+			const unsigned long acs = (cell.is_glyph ? unc::glyph_to_acs(cell.glyph) : 0);
+			const wchar_t chars[2] = { static_cast<wchar_t>(cell.is_glyph ? acs & A_CHARTEXT : cell.glyph), 0 };
+			setcchar(&blit_row[i], chars, ((acs & A_ATTRIBUTES) | cell.attr) & ~A_COLOR, PAIR_NUMBER(cell.attr), nullptr);
+#else
+			blit_row[i] = (cell.is_glyph ? unc::glyph_to_acs(cell.glyph) : cell.glyph & A_CHARTEXT) | cell.attr;
+#endif
+		}
+		blit_row[width] = decltype(blit_row)::value_type();
+#if defined(NCURSES_VERSION) && NCURSES_WIDECHAR
+		mvwadd_wchnstr(win, y + row, x, blit_row.data(), width);
+#else
+		mvwaddchnstr(win, y + row, x, blit_row.data(), width);
+#endif
+	}
+	wmove(win, old_y, old_x);
+}
+
 // Draws a box around the edge of a Window.
-void box(std::shared_ptr<unc::Window> window, unc::Colour colour, unsigned int flags)
+void box(unc::WindowRef window, unc::Colour colour, unsigned int flags)
 {
 	stack_trace();
 	WINDOW *win = (window ? window->win() : stdscr);
@@ -112,43 +1701,78 @@ void box(std::shared_ptr<unc::Window> window, unc::Colour colour, unsigned int f
 	if (reverse) colour_flags |= A_REVERSE;
 	if (blink) colour_flags |= A_BLINK;
 
-	if (colour != unc::Colour::NONE) wattron(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
+	unc::set_attr(win, colour == unc::Colour::NONE ? 0 : COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
 	::box(win, 0, 0);
-	if (colour != unc::Colour::NONE) wattroff(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
 }
 
 // Clears the current line.
-void clear_line(std::shared_ptr<Window> window)
+void clear_line(unc::WindowRef window)
 {
 	stack_trace();
 	WINDOW *win = (window ? window->win() : stdscr);
 	wclrtoeol(win);
 }
 
-// Clears the screen.
-void cls(std::shared_ptr<unc::Window> window)
+// Empties the word-wrap layout cache and resets its statistics.
+void clear_wrap_cache()
+{
+	stack_trace();
+	wrap_cache.clear();
+	wrap_cache_index.clear();
+	wrap_cache_hits = wrap_cache_misses = 0;
+}
+
+// Clears the screen, or a Window. Only the contents are blanked, and the terminal is updated as usual at the next flip(); with full_repaint set, the whole terminal is cleared and
+// redrawn from scratch instead, which is useful after the screen has been corrupted.
+void cls(unc::WindowRef window, bool full_repaint)
 {
 	stack_trace();
 #ifdef PDCURSES
 	// Workaround to deal with PDCurses' lack of an inbuilt SIGWINCH handler.
-	if (is_termresized())
-	{
-		resize_term(0, 0);
-		if (unc::get_cols() < 80 || unc::get_rows() < 24) resize_term(24, 80);
-		curs_set(cursor_state);
-	}
+	if (is_termresized()) unc::resize_screen(0, 0);
+#endif
+	WINDOW *win = (window ? window->win() : stdscr);
+	werase(win);
+	if (!full_repaint) return;
+	clearok(win, TRUE);
+#ifdef UNC_DIRECT_OUTPUT
+	if (output_backend == Backend::ANSI) ansi_redraw = true;
 #endif
-	if (!window) clear();
-	else wclear(window->win());
 }
 
-// Refreshes the screen.
+// Counts the lines a string would be split into by vector_split(), without building them.
+unsigned int count_lines(std::string_view text, unsigned int line_len)
+{
+	stack_trace();
+	unsigned int count = 0;
+	for (LineRange::iterator it = unc::split_lines(text, line_len).begin(), end; it != end; ++it)
+		count++;
+	return count;
+}
+
+// Measures the display width of a string in columns, allowing for UTF-8 wide and zero-width characters.
+unsigned int display_width(std::string_view text)
+{
+	if (unc::is_ascii(text.data(), text.size())) return text.size();
+	return unc::utf8_width(text.data(), text.size());
+}
+
+// Refreshes the screen. With a frame rate limit set, this may only mark the screen as needing a refresh, which then happens on a later flip() or get_key().
 void flip()
 {
 	stack_trace();
-	if (unc::get_cols() < 80 || unc::get_rows() < 24) resize_term(24, 80);
-	update_panels();
-	refresh();
+	frame_counters.frames_requested++;
+	const auto interval = std::max(frame_interval, quality_interval);
+	if (interval.count() && std::chrono::steady_clock::now() - last_present < interval) frame_pending = true;
+	else unc::present_frame();
+}
+
+// Refreshes the screen immediately, regardless of any frame rate limit.
+void flip_now()
+{
+	stack_trace();
+	frame_counters.frames_requested++;
+	unc::present_frame();
 }
 
 // Flushes the input buffer.
@@ -158,16 +1782,28 @@ void flush()
 	flushinp();
 }
 
+// Returns the frame statistics gathered since the last reset_frame_stats().
+FrameStats frame_stats()
+{
+	FrameStats stats = frame_counters;
+#ifdef UNC_DIRECT_OUTPUT
+	stats.bytes_written = ansi_bytes_written;
+	stats.write_calls = ansi_write_calls;
+	stats.write_ns = ansi_write_ns;
+#endif
+	return stats;
+}
+
 // Gets the number of columns available on the screen right now.
-unsigned int get_cols(std::shared_ptr<unc::Window> window)
+unsigned int get_cols(unc::WindowRef window)
 {
 	stack_trace();
 	if (window) return window->get_width();
-	else return getmaxx(stdscr);
+	else return screen_cols;
 }
 
 // Gets the current cursor X coordinate.
-unsigned int get_cursor_x(std::shared_ptr<unc::Window> window)
+unsigned int get_cursor_x(unc::WindowRef window)
 {
 	stack_trace();
 	WINDOW *win = (window ? window->win() : stdscr);
@@ -175,62 +1811,109 @@ unsigned int get_cursor_x(std::shared_ptr<unc::Window> window)
 }
 
 // Gets the current cursor Y coordinate.
-unsigned int get_cursor_y(std::shared_ptr<unc::Window> window)
+unsigned int get_cursor_y(unc::WindowRef window)
 {
 	stack_trace();
 	WINDOW *win = (window ? window->win() : stdscr);
 	return getcury(win);
 }
 
-// Gets a keypress as input.
-int get_key(std::shared_ptr<unc::Window> window)
+// Gets a keypress as input, or the next key from the queue with the headless backend.
+int get_key(unc::WindowRef window)
 {
 	stack_trace();
 	WINDOW *win = (window ? window->win() : stdscr);
-	int key = wgetch(win);
-	if (key == KEY_RESIZE)
+	if (frame_pending) unc::present_frame();	// Make sure the screen is up to date before waiting for input.
+	int key = ERR;
+	if (output_backend == Backend::HEADLESS)
+	{
+		if (headless_keys.empty()) throw std::runtime_error("Headless key queue is empty.");
+		key = headless_keys.front();
+		headless_keys.pop_front();
+	}
+	else
+	{
+		if (getattrs(win)) wattrset(win, 0);	// print() and box() leave their style set on the Window, which curses would otherwise use to echo the key.
+		key = wgetch(win);
+	}
+#ifdef UNC_DIRECT_OUTPUT
+	if (key == ERR && ansi_winch)
 	{
-		resize_term(0, 0);
-		if (unc::get_cols() < 80 || unc::get_rows() < 24) resize_term(24, 80);
-		curs_set(cursor_state);
+		// The read was interrupted by SIGWINCH. curses keeps the failed read in its input queue as an ERR, which is cleared out here so it isn't returned by the next get_key().
+		const bool was_nodelay = is_nodelay(win);
+		nodelay(win, true);
+		const int next_key = wgetch(win);
+		if (next_key != ERR) ungetch(next_key);
+		nodelay(win, was_nodelay);
+		key = KEY_RESIZE;
 	}
+#endif
+	// The headless backend has already been resized by set_headless_size(), and the ANSI backend only needs to act if it hasn't already done so in flip().
+	if (key == KEY_RESIZE && output_backend == Backend::NATIVE) unc::resize_screen(0, 0);
+#ifdef UNC_DIRECT_OUTPUT
+	else if (key == KEY_RESIZE && output_backend == Backend::ANSI) unc::ansi_check_size();
+#endif
 	return key;
 }
 
 // Gets the central column of the specified unc::Window.
-unsigned int get_midcol(std::shared_ptr<unc::Window> window)
+unsigned int get_midcol(unc::WindowRef window)
 {
 	stack_trace();
 	return unc::get_cols(window) / 2;
 }
 
 // Gets the central row of the specified unc::Window.
-unsigned int get_midrow(std::shared_ptr<unc::Window> window)
+unsigned int get_midrow(unc::WindowRef window)
 {
 	stack_trace();
 	return unc::get_rows(window) / 2;
 }
 
 // Gets the number of rows available on the screen right now.
-unsigned int get_rows(std::shared_ptr<unc::Window> window)
+unsigned int get_rows(unc::WindowRef window)
 {
 	stack_trace();
 	if (window) return window->get_height();
-	else return getmaxy(stdscr);
+	else return screen_rows;
 }
 
 // C++ std::string wrapper around the PDCurses wgetnstr() function.
-std::string get_string(std::shared_ptr<unc::Window> window)
+std::string get_string(unc::WindowRef window)
 {
 	stack_trace();
 	WINDOW *win = (window ? window->win() : stdscr);
+	unc::set_attr(win, 0);	// print() and box() leave their style set on the Window, which would otherwise carry over to the echoed input.
+	if (output_backend == Backend::HEADLESS)
+	{
+		// The same basic line editing as wgetnstr(), but reading keys from the headless key queue.
+		std::string result;
+		while (true)
+		{
+			const int key = unc::get_key(window);
+			if (key == '\n' || key == '\r' || key == KEY_ENTER) break;
+			else if (key == KEY_BACKSPACE || key == '\b' || key == 127)
+			{
+				if (!result.size()) continue;
+				result.pop_back();
+				if (cursor_state) waddstr(win, "\b \b");
+			}
+			else if (key >= ' ' && key < 256 && result.size() < 255)
+			{
+				result += static_cast<char>(key);
+				if (cursor_state) waddch(win, key);
+			}
+		}
+		return result;
+	}
+	if (frame_pending) unc::present_frame();
 	char buffer[256];
 	wgetnstr(win, buffer, 255);
 	return buffer;
 }
 
 // Sets up Curses.
-void init(std::string syslog_filename)
+void init(std::string syslog_filename, Backend backend)
 {
 	stack_trace();
 #ifdef USING_GURU_MEDITATION
@@ -240,11 +1923,46 @@ void init(std::string syslog_filename)
 	guru::open_sysog();
 #endif
 #endif
-	initscr();
+	setlocale(LC_CTYPE, "");	// curses has to know the character encoding before it starts, or anything outside ASCII gets treated as separate single bytes.
+#ifdef UNC_DIRECT_OUTPUT
+	if (backend == Backend::ANSI && isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))
+	{
+		// curses still composes the screen, but its own output goes to /dev/null; ansi_present() sends the finished frames to the terminal.
+		struct sigaction action = { };
+		action.sa_handler = unc::ansi_sigwinch;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGWINCH, &action, nullptr);
+		if (!curses_output) curses_output = fopen("/dev/null", "w");
+		if (curses_output) curses_screen = newterm(nullptr, curses_output, stdin);
+		if (curses_screen) output_backend = Backend::ANSI;
+		else signal(SIGWINCH, SIG_DFL);
+	}
+	else if (backend == Backend::HEADLESS)
+	{
+		// There may be no terminal at all, and TERM may not be set, so this tries a few terminal types in turn; curses only needs one it can compose a screen for.
+		if (!curses_input) curses_input = fopen("/dev/null", "r");
+		if (!curses_output) curses_output = fopen("/dev/null", "w");
+		const char *term_env = getenv("TERM");
+		const char *term_types[] = { term_env, "xterm-256color", "xterm", "vt100" };
+		for (auto term_type : term_types)
+			if (curses_input && curses_output && term_type && !curses_screen) curses_screen = newterm(term_type, curses_output, curses_input);
+		if (!curses_screen) throw std::runtime_error("Could not start the headless backend.");
+		output_backend = Backend::HEADLESS;
+	}
+#else
+	// Only the curses backend is available in this build. ANSI can fall back to it and still drive the terminal, but HEADLESS is meant to run without one, so it mustn't.
+	if (backend == Backend::HEADLESS) throw std::runtime_error("The headless backend needs NCurses with wide character support.");
+#endif
+	if (output_backend == Backend::NATIVE) initscr();
 	cbreak();
 	unc::set_cursor(true);
 	keypad(stdscr, true);
+	if (output_backend == Backend::HEADLESS) unc::resize_screen(headless_rows, headless_cols);
+	else unc::resize_screen(getmaxy(stdscr), getmaxx(stdscr));
 	unc::init_colours();
+#ifdef UNC_DIRECT_OUTPUT
+	if (output_backend == Backend::ANSI) unc::ansi_start();
+#endif
 
 #ifdef USING_GURU_MEDITATION
 	guru::console_ready(true);
@@ -265,6 +1983,8 @@ void init_colours()
 	init_pair(static_cast<unsigned int>(unc::Colour::MAGENTA), COLOR_MAGENTA, COLOR_BLACK);
 	init_pair(static_cast<unsigned int>(unc::Colour::CYAN), COLOR_CYAN, COLOR_BLACK);
 	init_pair(static_cast<unsigned int>(unc::Colour::WHITE), COLOR_WHITE, COLOR_BLACK);
+	for (auto window : unc::windows())
+		window->clear_chrome();
 }
 
 // Checks if a key is a cancel key (escape).
@@ -303,8 +2023,42 @@ bool is_up(int key)
 	return (key == KEY_UP || key == 'w' || key == 'W');
 }
 
+// Returns the frame statistics for the most recently presented frame alone.
+FrameStats last_frame_stats()
+{
+	return last_frame_counters;
+}
+
+// Builds a Cell for blit(), resolving its colour and flags into curses attributes.
+Cell make_cell(unsigned int glyph, unc::Colour colour, unsigned int flags)
+{
+	Cell cell;
+	cell.attr = unc::style_attr(colour, flags);
+	cell.glyph = glyph;
+	cell.is_glyph = false;
+	return cell;
+}
+
+// As above, but for a unc::Glyph.
+Cell make_cell(unc::Glyph glyph, unc::Colour colour, unsigned int flags)
+{
+	Cell cell = unc::make_cell(static_cast<unsigned int>(glyph), colour, flags);
+	cell.is_glyph = true;
+	return cell;
+}
+
+// Returns a compiled Markup for the given text, compiling it only the first time it's seen. Intended for static UI strings, as nothing is ever removed from the cache.
+const Markup& markup(std::string_view source)
+{
+	stack_trace();
+	auto found = markup_cache.find(source);
+	if (found != markup_cache.end()) return found->second;
+	markup_sources.emplace_back(source);
+	return markup_cache.emplace(markup_sources.back(), Markup(source)).first->second;
+}
+
 // Moves the cursor to the given coordinates; -1 for either coordinate retains its current position on that axis.
-void move_cursor(int x, int y, std::shared_ptr<unc::Window> window)
+void move_cursor(int x, int y, unc::WindowRef window)
 {
 	stack_trace();
 	if (x == -1 && y == -1) return;
@@ -317,58 +2071,204 @@ void move_cursor(int x, int y, std::shared_ptr<unc::Window> window)
 }
 
 // Parses a string into a Colour, or Colour::NONE if it could not be parsed.
-Colour parse_colour(std::string input)
+Colour parse_colour(std::string_view input)
 {
 	stack_trace();
 	if (!input.size()) return Colour::NONE;
-#ifdef USING_POTLUCK
-	input = potluck::str_toupper(input);
-#else
-	std::transform(input.begin(), input.end(), input.begin(), ::toupper);
-#endif
-
-	if (input == "BLACK") return Colour::BLACK;
-	else if (input == "RED") return Colour::RED;
-	else if (input == "GREEN") return Colour::GREEN;
-	else if (input == "YELLOW") return Colour::YELLOW;
-	else if (input == "BLUE") return Colour::BLUE;
-	else if (input == "MAGENTA") return Colour::MAGENTA;
-	else if (input == "CYAN") return Colour::CYAN;
-	else if (input == "WHITE") return Colour::WHITE;
-	else if (input == "BLACK_BOLD") return Colour::BLACK_BOLD;
-	else if (input == "RED_BOLD") return Colour::RED_BOLD;
-	else if (input == "GREEN_BOLD") return Colour::GREEN_BOLD;
-	else if (input == "YELLOW_BOLD") return Colour::YELLOW_BOLD;
-	else if (input == "BLUE_BOLD") return Colour::BLUE_BOLD;
-	else if (input == "MAGENTA_BOLD") return Colour::MAGENTA_BOLD;
-	else if (input == "CYAN_BOLD") return Colour::CYAN_BOLD;
-	else if (input == "WHITE_BOLD") return Colour::WHITE_BOLD;
+
+	if (unc::iequals(input, "BLACK")) return Colour::BLACK;
+	else if (unc::iequals(input, "RED")) return Colour::RED;
+	else if (unc::iequals(input, "GREEN")) return Colour::GREEN;
+	else if (unc::iequals(input, "YELLOW")) return Colour::YELLOW;
+	else if (unc::iequals(input, "BLUE")) return Colour::BLUE;
+	else if (unc::iequals(input, "MAGENTA")) return Colour::MAGENTA;
+	else if (unc::iequals(input, "CYAN")) return Colour::CYAN;
+	else if (unc::iequals(input, "WHITE")) return Colour::WHITE;
+	else if (unc::iequals(input, "BLACK_BOLD")) return Colour::BLACK_BOLD;
+	else if (unc::iequals(input, "RED_BOLD")) return Colour::RED_BOLD;
+	else if (unc::iequals(input, "GREEN_BOLD")) return Colour::GREEN_BOLD;
+	else if (unc::iequals(input, "YELLOW_BOLD")) return Colour::YELLOW_BOLD;
+	else if (unc::iequals(input, "BLUE_BOLD")) return Colour::BLUE_BOLD;
+	else if (unc::iequals(input, "MAGENTA_BOLD")) return Colour::MAGENTA_BOLD;
+	else if (unc::iequals(input, "CYAN_BOLD")) return Colour::CYAN_BOLD;
+	else if (unc::iequals(input, "WHITE_BOLD")) return Colour::WHITE_BOLD;
 	else return Colour::NONE;
 }
 
 // Parses a string into flags (such as UNC_BOLD | UNC_REVERSE), or 0 if nothing could be parsed from the string.
-unsigned int parse_flags(std::string input)
+unsigned int parse_flags(std::string_view input)
 {
 	stack_trace();
 	if (!input.size()) return 0;
-#ifdef USING_POTLUCK
-	input = potluck::str_toupper(input);
-#else
-	std::transform(input.begin(), input.end(), input.begin(), ::toupper);
-#endif
 
 	unsigned int flags = 0;
-	if (input.find("BOLD") != std::string::npos) flags |= UNC_BOLD;
-	if (input.find("NL") != std::string::npos) flags |= UNC_NL;
-	if (input.find("RAW") != std::string::npos) flags |= UNC_RAW;
-	if (input.find("REVERSE") != std::string::npos) flags |= UNC_REVERSE;
-	if (input.find("DOUBLE") != std::string::npos) flags |= UNC_DOUBLE;
-	if (input.find("BLINK") != std::string::npos) flags |= UNC_BLINK;
+	if (unc::icontains(input, "BOLD")) flags |= UNC_BOLD;
+	if (unc::icontains(input, "NL")) flags |= UNC_NL;
+	if (unc::icontains(input, "RAW")) flags |= UNC_RAW;
+	if (unc::icontains(input, "REVERSE")) flags |= UNC_REVERSE;
+	if (unc::icontains(input, "DOUBLE")) flags |= UNC_DOUBLE;
+	if (unc::icontains(input, "BLINK")) flags |= UNC_BLINK;
 	return flags;
 }
 
+// Walks the word-wrap break rules used by print(), calling line_func(offset, length, last) for each line of the text in turn, and measure(text, length) to get the display width of each word.
+// Every line except the last is followed by a line break; lines are always contiguous slices of the original text.
+template <typename M, typename F> void wrap_scan(const char *text, size_t len, unsigned int width, unsigned int start_col, M measure, F line_func)
+{
+	unsigned int current_pos = start_col;
+	size_t line_start = 0, line_len = 0;	// The line waiting to be printed, as a slice of the input text.
+	size_t line_cols = 0;					// The display width of the waiting line.
+	size_t word_start = 0, pos = 0;
+
+	// Any spaces at the start of the text are kept as part of the first word.
+	while (pos < len && text[pos] == ' ') pos++;
+	while (true)
+	{
+		const char *space = static_cast<const char*>(memchr(text + pos, ' ', len - pos));
+		const size_t word_end = (space ? space - text : len);
+		const size_t word_len = word_end - word_start;
+		const size_t word_cols = measure(text + word_start, word_len);
+		if (line_cols + word_cols + current_pos >= width)
+		{
+			line_func(line_start, line_len, false);
+			line_start = word_start;
+			line_len = word_len;
+			line_cols = word_cols;
+			current_pos = 0;
+		}
+		else if (line_len)
+		{
+			line_len = word_end - line_start;	// Words are only ever separated by a single space, so the line is always a contiguous slice.
+			line_cols += word_cols + 1;
+		}
+		else
+		{
+			line_start = word_start;
+			line_len = word_len;
+			line_cols = word_cols;
+		}
+		if (!space) break;
+		word_start = pos = word_end + 1;
+	}
+	line_func(line_start, line_len, true);
+}
+
+// Word-wraps text with wrap_scan(), measuring words by byte count when the text is pure ASCII, or by UTF-8 display width otherwise.
+template <typename F> void wrap_text(const char *text, size_t len, unsigned int width, unsigned int start_col, F line_func)
+{
+	if (unc::is_ascii(text, len)) unc::wrap_scan(text, len, width, start_col, [](const char*, size_t length) { return length; }, line_func);
+	else unc::wrap_scan(text, len, width, start_col, [](const char *word, size_t length) { return static_cast<size_t>(unc::utf8_width(word, length)); }, line_func);
+}
+
+// Works out how text would be laid out by print(), without drawing anything. The Window is assumed to be tall enough to hold all of the text.
+TextMetrics measure(std::string_view text, unsigned int width, unsigned int start_col)
+{
+	stack_trace();
+	TextMetrics metrics = {0, start_col, start_col};
+	if (!text.size() || !width) return metrics;
+	const bool ascii = unc::is_ascii(text.data(), text.size());
+	unsigned int row = 0, col = start_col;
+	unc::wrap_text(text.data(), text.size(), width, start_col, [&](size_t offset, size_t length, bool last) {
+		if (ascii)
+		{
+			if (col + length > metrics.widest) metrics.widest = (col + length < width ? col + length : width);
+			col += length;
+			row += col / width;	// Curses wraps the cursor to the next line as soon as the last column is filled.
+			col %= width;
+		}
+		else
+		{
+			// Curses won't split a 2-column character across two lines, so one that doesn't fit in the space left is moved on to the next line, leaving a gap behind it.
+			size_t pos = offset;
+			while (pos < offset + length)
+			{
+				const unsigned int char_cols = unc::codepoint_width(unc::decode_utf8(text.data(), offset + length, pos));
+				if (!char_cols) continue;
+				if (col + char_cols > width)
+				{
+					row++;
+					col = 0;
+				}
+				col += char_cols;
+				if (col > metrics.widest) metrics.widest = col;
+				if (col >= width)
+				{
+					row++;
+					col = 0;
+				}
+			}
+		}
+		if (!last && col)
+		{
+			row++;
+			col = 0;
+		}
+	});
+	metrics.rows = (col || !row ? row + 1 : row);
+	metrics.end_col = col;
+	return metrics;
+}
+
+// Prints one line handed over by wrap_text(), or replayed from the wrap cache.
+void print_wrapped_line(const char *text, size_t offset, size_t length, bool last, WINDOW *win)
+{
+	if (length) waddnstr(win, text + offset, length);
+	if (!last && getcurx(win) != 0) waddch(win, '\n');
+}
+
+// Word-wraps a block of text onto a WINDOW in a single pass, handing each line to curses as a slice of the original string.
+void print_wrapped(std::string_view text, unsigned int width, WINDOW *win)
+{
+	const unsigned int start_col = getcurx(win);
+	if (!wrap_cache_max)
+	{
+		unc::wrap_text(text.data(), text.size(), width, start_col, [&text, win](size_t offset, size_t length, bool last) { unc::print_wrapped_line(text.data(), offset, length, last, win); });
+		return;
+	}
+
+	const std::vector<Slice> &lines = unc::wrap_layout(text, width, start_col);
+	for (unsigned int i = 0; i < lines.size(); i++)
+		unc::print_wrapped_line(text.data(), lines.at(i).offset, lines.at(i).length, i == lines.size() - 1, win);
+}
+
+// Looks up the word-wrap layout for a string in the wrap cache, building and storing it if it's not already there.
+const std::vector<Slice>& wrap_layout(std::string_view text, unsigned int width, unsigned int start_col)
+{
+	const size_t text_hash = std::hash<std::string_view>()(text);
+	const size_t key = text_hash ^ ((static_cast<size_t>(width) << 16 | start_col) * 0x9E3779B97F4A7C15ULL);
+	auto found = wrap_cache_index.find(key);
+	if (found != wrap_cache_index.end())
+	{
+		WrapLayout &layout = *found->second;
+		if (layout.width == width && layout.start_col == start_col && layout.text == text)
+		{
+			wrap_cache_hits++;
+			wrap_cache.splice(wrap_cache.begin(), wrap_cache, found->second);
+			return layout.lines;
+		}
+		wrap_cache.erase(found->second);	// Two different layouts with the same key; the old one gets replaced.
+		wrap_cache_index.erase(found);
+	}
+
+	wrap_cache_misses++;
+	while (wrap_cache.size() >= wrap_cache_max)
+	{
+		wrap_cache_index.erase(wrap_cache.back().key);
+		wrap_cache.pop_back();
+	}
+	wrap_cache.push_front(WrapLayout());
+	WrapLayout &layout = wrap_cache.front();
+	layout.key = key;
+	layout.text = text;
+	layout.width = width;
+	layout.start_col = start_col;
+	unc::wrap_text(text.data(), text.size(), width, start_col, [&layout](size_t offset, size_t length, bool) { layout.lines.push_back({offset, length}); });
+	wrap_cache_index[key] = wrap_cache.begin();
+	return layout.lines;
+}
+
 // Prints a string on the screen, with optional word-wrap.
-void print(std::string input, unc::Colour colour, unsigned int flags, int x, int y, std::shared_ptr<unc::Window> window)
+void print(std::string_view input, unc::Colour colour, unsigned int flags, int x, int y, unc::WindowRef window)
 {
 	stack_trace();
 	if (!input.size()) return;
@@ -395,51 +2295,110 @@ void print(std::string input, unc::Colour colour, unsigned int flags, int x, int
 
 	if (raw)
 	{
-		if (!no_colour) wattron(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
+		unc::set_attr(win, no_colour ? 0 : COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
 		const int available_size = unc::get_cols(window) - unc::get_cursor_x(window);
-		if (static_cast<signed>(input.size()) >= available_size) input = input.substr(0, available_size - 1);
-		waddstr(win, input.c_str());
+		int print_len = input.size();
+		if (available_size > 0 && static_cast<int>(unc::display_width(input)) >= available_size) print_len = unc::prefix_for_width(input.data(), input.size(), available_size - 1);
+		if (print_len > 0) waddnstr(win, input.data(), print_len);
 		if (newline) waddch(win, '\n');
-		if (!no_colour) wattroff(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
 		return;
 	}
 
-	unsigned int spaces_at_start = 0;
-	while (input.size() && input[0] == ' ')
+	unc::set_attr(win, no_colour ? 0 : COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
+	unc::print_wrapped(input, unc::get_cols(window), win);
+	if (newline && getcurx(win) != 0) waddch(win, '\n');
+}
+
+// As above, but for a string that isn't null-terminated.
+void print(const char *input, size_t length, unc::Colour colour, unsigned int flags, int x, int y, unc::WindowRef window)
+{
+	unc::print(std::string_view(input, length), colour, flags, x, y, window);
+}
+
+// As above, but for text with inline style tags, compiled into a Markup.
+void print(const Markup &input, unsigned int flags, int x, int y, unc::WindowRef window)
+{
+	stack_trace();
+	const std::string &text = input.text();
+	const std::vector<StyleRun> &runs = input.runs();
+	if (!text.size()) return;
+
+	WINDOW *win = (window ? window->win() : stdscr);
+	unc::move_cursor(x, y, window);
+	attr_t old_attr;
+	short old_pair;
+	wattr_get(win, &old_attr, &old_pair, nullptr);
+
+	// Prints a section of the text, only changing the window attributes when crossing into a run with a different style.
+	unsigned int run = 0;
+	unsigned long current_attr = ~0UL;
+	auto print_section = [&](size_t offset, size_t length) {
+		const size_t end = offset + length;
+		while (offset < end)
+		{
+			while (runs.at(run).offset + runs.at(run).length <= offset) run++;
+			const size_t section_end = std::min(end, runs.at(run).offset + runs.at(run).length);
+			if (runs.at(run).attr != current_attr)
+			{
+				current_attr = runs.at(run).attr;
+				wattrset(win, current_attr);
+			}
+			waddnstr(win, text.data() + offset, section_end - offset);
+			offset = section_end;
+		}
+	};
+
+	if ((flags & UNC_RAW) == UNC_RAW)
 	{
-		input = input.substr(1);
-		spaces_at_start++;
+		const int available_size = unc::get_cols(window) - getcurx(win);
+		size_t print_len = text.size();
+		if (available_size > 0 && static_cast<int>(unc::display_width(text)) >= available_size) print_len = unc::prefix_for_width(text.data(), text.size(), available_size - 1);
+		print_section(0, print_len);
+		if ((flags & UNC_NL) == UNC_NL) waddch(win, '\n');
 	}
-	const unsigned int width = unc::get_cols(window);
-	unsigned int current_pos = unc::get_cursor_x(window);
-	std::vector<std::string> words = unc::string_explode(input, " ");
-	std::string line;
-	if (words.size() && spaces_at_start) words.at(0) = std::string(spaces_at_start, ' ') + words.at(0);
-	if (!no_colour) wattron(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
-	while (words.size())
+	else
 	{
-		std::string word = words.at(0);
-		words.erase(words.begin());
-		if (line.size() + word.size() + current_pos >= width)
-		{
-			waddstr(win, line.c_str());
-			line = word;
-			current_pos = 0;
-			if (unc::get_cursor_x(window) != 0) waddch(win, '\n');
-		}
-		else
+		unc::wrap_text(text.data(), text.size(), unc::get_cols(window), getcurx(win), [&](size_t offset, size_t length, bool last) {
+			print_section(offset, length);
+			if (!last && getcurx(win) != 0) waddch(win, '\n');
+		});
+		if ((flags & UNC_NL) == UNC_NL && getcurx(win) != 0) waddch(win, '\n');
+	}
+	wattr_set(win, old_attr, old_pair, nullptr);
+}
+
+// Prints a StaticMarkup's pre-resolved cells; used by the print() template for StaticMarkup.
+void print_cells(const unsigned int *cells, size_t cell_count, const StaticRun *runs, size_t run_count, unsigned int flags, int x, int y, unc::WindowRef window)
+{
+	stack_trace();
+	if (!cell_count) return;
+	WINDOW *win = (window ? window->win() : stdscr);
+	unc::move_cursor(x, y, window);
+	const int available_size = unc::get_cols(window) - getcurx(win);
+	if (available_size > 0 && static_cast<int>(cell_count) >= available_size) cell_count = available_size - 1;
+
+	attr_t old_attr;
+	short old_pair;
+	wattr_get(win, &old_attr, &old_pair, nullptr);
+	unsigned long current_attr = ~0UL;
+	for (size_t r = 0; r < run_count && runs[r].offset < cell_count; r++)
+	{
+		const unsigned long attr = unc::style_attr(runs[r].colour, runs[r].flags);
+		if (attr != current_attr)
 		{
-			if (line.size()) line += " " + word;
-			else line = word;
+			current_attr = attr;
+			wattrset(win, current_attr);
 		}
+		const size_t end = std::min(cell_count, runs[r].offset + runs[r].length);
+		for (size_t i = runs[r].offset; i < end; i++)
+			waddch(win, cells[i] > 255 ? unc::glyph_to_acs(cells[i]) : cells[i]);
 	}
-	if (line.size()) waddstr(win, (line).c_str());
-	if (newline && unc::get_cursor_x(window) != 0) waddch(win, '\n');
-	if (!no_colour) wattroff(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
+	if ((flags & UNC_NL) == UNC_NL) waddch(win, '\n');
+	wattr_set(win, old_attr, old_pair, nullptr);
 }
 
 // As above, but for a single character.
-void print(int input, unc::Colour colour, unsigned int flags, int x, int y, std::shared_ptr<unc::Window> window)
+void print(int input, unc::Colour colour, unsigned int flags, int x, int y, unc::WindowRef window)
 {
 	stack_trace();
 
@@ -462,67 +2421,57 @@ void print(int input, unc::Colour colour, unsigned int flags, int x, int y, std:
 	if (reverse) colour_flags |= A_REVERSE;
 	if (blink) colour_flags |= A_BLINK;
 
-	if (input > 255)
-	{
-		switch(static_cast<unc::Glyph>(input))
-		{
-			case unc::Glyph::ULCORNER: input = ACS_ULCORNER; break;
-			case unc::Glyph::LLCORNER: input = ACS_LLCORNER; break;
-			case unc::Glyph::URCORNER: input = ACS_URCORNER; break;
-			case unc::Glyph::LRCORNER: input = ACS_LRCORNER; break;
-			case unc::Glyph::RTEE: input = ACS_RTEE; break;
-			case unc::Glyph::LTEE: input = ACS_LTEE; break;
-			case unc::Glyph::BTEE: input = ACS_BTEE; break;
-			case unc::Glyph::TTEE: input = ACS_TTEE; break;
-			case unc::Glyph::HLINE: input = ACS_HLINE; break;
-			case unc::Glyph::VLINE: input = ACS_VLINE; break;
-			case unc::Glyph::PLUS: input = ACS_PLUS; break;
-			case unc::Glyph::S1: input = ACS_S1; break;
-			case unc::Glyph::S9: input = ACS_S9; break;
-			case unc::Glyph::DIAMOND: input = ACS_DIAMOND; break;
-			case unc::Glyph::CKBOARD: input = ACS_CKBOARD; break;
-			case unc::Glyph::DEGREE: input = ACS_DEGREE; break;
-			case unc::Glyph::PLMINUS: input = ACS_PLMINUS; break;
-			case unc::Glyph::BULLET: input = ACS_BULLET; break;
-			case unc::Glyph::LARROW: input = ACS_LARROW; break;
-			case unc::Glyph::RARROW: input = ACS_RARROW; break;
-			case unc::Glyph::DARROW: input = ACS_DARROW; break;
-			case unc::Glyph::UARROW: input = ACS_UARROW; break;
-			case unc::Glyph::BOARD: input = ACS_BOARD; break;
-			case unc::Glyph::LANTERN: input = ACS_LANTERN; break;
-			case unc::Glyph::BLOCK: input = ACS_BLOCK; break;
-			case unc::Glyph::S3: input = ACS_S3; break;
-			case unc::Glyph::S7: input = ACS_S7; break;
-			case unc::Glyph::LEQUAL: input = ACS_LEQUAL; break;
-			case unc::Glyph::GEQUAL: input = ACS_GEQUAL; break;
-			case unc::Glyph::PI: input = ACS_PI; break;
-			case unc::Glyph::NEQUAL: input = ACS_NEQUAL; break;
-			case unc::Glyph::STERLING: input = ACS_STERLING; break;
-		}
-	}
-
-	if (!no_colour) wattron(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
+	if (input > 255) input = unc::glyph_to_acs(input);
+
+	unc::set_attr(win, no_colour ? 0 : COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
 	waddch(win, input);
 	if (render_double) waddch(win, input);
-	if (!no_colour) wattroff(win, COLOR_PAIR(static_cast<unsigned int>(colour)) | colour_flags);
 }
 
 // Simple wrapper for unc::Glyph glyphs.
-void print(unc::Glyph input, unc::Colour colour, unsigned int flags, int x, int y, std::shared_ptr<unc::Window> window)
+void print(unc::Glyph input, unc::Colour colour, unsigned int flags, int x, int y, unc::WindowRef window)
 {
 	stack_trace();
 	unc::print(static_cast<int>(input), colour, flags, x, y, window);
 }
 
 // This just makes it easier to do a newline print() on a unc::Window.
-void print(std::shared_ptr<unc::Window> window, int newline_count)
+void print(unc::WindowRef window, int newline_count)
 {
 	for (int i = 0; i < newline_count; i++)
 		unc::print('\n', unc::Colour::NONE, 0, -1, -1, window);
 }
 
+// Adds a key to the end of the headless backend's key queue.
+void queue_key(int key)
+{
+	stack_trace();
+	headless_keys.push_back(key);
+}
+
+// Adds each character of a string to the end of the headless backend's key queue.
+void queue_keys(std::string_view keys)
+{
+	stack_trace();
+	for (auto key : keys)
+		headless_keys.push_back(static_cast<unsigned char>(key));
+}
+
+// Returns the current adaptive quality level: 0 is full quality, and each level above that degrades output further (see set_adaptive_quality()).
+unsigned int quality_level()
+{
+	return quality;
+}
+
+// Removes a function registered with add_resize_callback().
+void remove_resize_callback(unsigned int id)
+{
+	stack_trace();
+	resize_callbacks.erase(std::remove_if(resize_callbacks.begin(), resize_callbacks.end(), [id](const auto &callback) { return callback.first == id; }), resize_callbacks.end());
+}
+
 // Renders a grid of the specified size.
-void render_grid(int x, int y, int w, int h, unc::Colour colour, std::shared_ptr<unc::Window> window)
+void render_grid(int x, int y, int w, int h, unc::Colour colour, unc::WindowRef window)
 {
 	stack_trace();
 	for (int gx = 0; gx < w; gx++)
@@ -568,6 +2517,88 @@ int resize_key()
 	return KEY_RESIZE;
 }
 
+// Resets the frame statistics to zero.
+void reset_frame_stats()
+{
+	frame_counters = FrameStats();
+#ifdef UNC_DIRECT_OUTPUT
+	ansi_bytes_written = 0;
+	ansi_write_calls = 0;
+	ansi_write_ns = 0;
+#endif
+	last_frame_counters = FrameStats();
+	last_frame_requests = 0;
+}
+
+// Reads back a single cell of the screen, as composed at the last flip().
+ScreenCell screen_cell(unsigned int x, unsigned int y)
+{
+	stack_trace();
+	ScreenCell result = { Colour::NONE, 0, "" };
+#ifdef UNC_DIRECT_OUTPUT
+	if (static_cast<int>(x) >= getmaxx(newscr) || static_cast<int>(y) >= getmaxy(newscr)) return result;
+	const int old_x = getcurx(newscr), old_y = getcury(newscr);
+	cchar_t screen_cell;
+	wchar_t chars[CCHARW_MAX + 1] = { };
+	attr_t attr = 0;
+	short pair = 0;
+	mvwin_wch(newscr, y, x, &screen_cell);
+	getcchar(&screen_cell, chars, &attr, &pair, nullptr);
+	wmove(newscr, old_y, old_x);
+
+	result.colour = static_cast<Colour>(pair);
+	if (attr & A_BOLD) result.flags |= UNC_BOLD;
+	if (attr & A_REVERSE) result.flags |= UNC_REVERSE;
+	if (attr & A_BLINK) result.flags |= UNC_BLINK;
+	if (attr & A_ALTCHARSET) unc::append_utf8(result.text, unc::acs_to_unicode(chars[0]));
+	else for (int i = 0; i < CCHARW_MAX && chars[i]; i++)
+		unc::append_utf8(result.text, chars[i]);
+#else
+	(void)x;
+	(void)y;
+	throw std::runtime_error("Reading back the screen needs NCurses with wide character support.");
+#endif
+	return result;
+}
+
+// Reads back the text on the screen as composed at the last flip(), one string per row.
+std::vector<std::string> screen_text()
+{
+	stack_trace();
+	std::vector<std::string> result;
+	const unsigned int cols = unc::get_cols(), rows = unc::get_rows();
+	for (unsigned int y = 0; y < rows; y++)
+	{
+		std::string line;
+		ScreenCell previous = { Colour::NONE, 0, "" };
+		for (unsigned int x = 0; x < cols; x++)
+		{
+			// The second column of a wide character reads back as a copy of it, which is skipped.
+			ScreenCell cell = unc::screen_cell(x, y);
+			if (previous.text.size() && unc::display_width(previous.text) == 2 && cell.text == previous.text && cell.colour == previous.colour && cell.flags == previous.flags)
+			{
+				previous = ScreenCell();
+				continue;
+			}
+			line += cell.text;
+			previous = cell;
+		}
+		result.push_back(line);
+	}
+	return result;
+}
+
+// Lowers the ANSI backend's output quality when the terminal can't keep up, and restores it when the terminal recovers. Blink is dropped first, then colour, then the frame rate is
+// limited, and finally only the Window with the cursor in it is updated.
+void set_adaptive_quality(bool enabled)
+{
+	stack_trace();
+	adaptive_quality = enabled;
+	if (enabled) return;
+	quality = 0;
+	quality_interval = std::chrono::steady_clock::duration::zero();
+}
+
 // Turns the cursor on or off.
 void set_cursor(bool enabled)
 {
@@ -586,16 +2617,69 @@ void set_cursor(bool enabled)
 	}
 }
 
+// Limits how often flip() actually sends the screen to the terminal (0 removes the limit). Frames requested in between are coalesced into one.
+void set_frame_rate_limit(unsigned int frames_per_second)
+{
+	stack_trace();
+	if (frames_per_second) frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / frames_per_second;
+	else frame_interval = std::chrono::steady_clock::duration::zero();
+}
+
+// Sets the size of the headless backend's screen. Unlike a real terminal, this isn't held to a minimum of 80x24, but it must be at least 1x1. If the headless backend is already
+// running, a KEY_RESIZE is put at the front of the key queue, as a real terminal would send.
+void set_headless_size(unsigned int cols, unsigned int rows)
+{
+	stack_trace();
+	if (!cols || !rows) throw std::runtime_error("Headless screen size must be at least 1x1.");
+	headless_cols = cols;
+	headless_rows = rows;
+	if (output_backend != Backend::HEADLESS) return;
+	unc::resize_screen(rows, cols);
+	headless_keys.push_front(KEY_RESIZE);
+}
+
 // Sets the console window title. Only works on PDCurses; does nothing on NCurses.
 #ifdef PDCURSES
-void set_window_title(std::string title)
+void set_window_title(std::string_view title)
 {
 	stack_trace();
-	PDC_set_title(title.c_str());
+	PDC_set_title(std::string(title).c_str());
 }
 #else
-void set_window_title(std::string) { }
+void set_window_title(std::string_view) { }
+#endif
+
+// Enables caching of word-wrap layouts for print(), up to the given number of layouts (0 disables the cache).
+void set_wrap_cache(unsigned int max_entries)
+{
+	stack_trace();
+	wrap_cache_max = max_entries;
+	while (wrap_cache.size() > wrap_cache_max)
+	{
+		wrap_cache_index.erase(wrap_cache.back().key);
+		wrap_cache.pop_back();
+	}
+}
+
+// Sends frames to the terminal from a separate thread when the ANSI backend is active, so a slow terminal doesn't hold up flip().
+void set_threaded_output(bool enabled)
+{
+	stack_trace();
+	threaded_output = enabled;
+#ifdef UNC_DIRECT_OUTPUT
+	if (output_backend != Backend::ANSI) return;
+	if (enabled) unc::ansi_writer_start();
+	else unc::ansi_writer_stop();
 #endif
+}
+
+// Enables skipping of unchanged rows at flip() time, by comparing a hash of each row against the last frame.
+void set_row_skipping(bool enabled)
+{
+	stack_trace();
+	row_skipping = enabled;
+	row_skipping_reset = true;
+}
 
 // Runs Curses cleanup code.
 void shutdown()
@@ -604,78 +2688,89 @@ void shutdown()
 	cursor_state = 1;
 	curs_set(1);
 	echo();
+#ifdef UNC_DIRECT_OUTPUT
+	if (output_backend == Backend::ANSI) unc::ansi_stop();
+#endif
 	endwin();
+#ifdef UNC_DIRECT_OUTPUT
+	// As with the native backend, the curses screen itself is left alone, as Windows may well outlive shutdown(). curses_input and curses_output are kept for the next init().
+	if (output_backend == Backend::ANSI) signal(SIGWINCH, SIG_DFL);
+	curses_screen = nullptr;
+	output_backend = Backend::NATIVE;
+#endif
 #ifdef USING_GURU_MEDITATION
 	guru::close_syslog();
 #endif
 }
 
-#ifndef USING_POTLUCK
-// Below this point are replacement libraries from the Potluck library, used when USING_POTLUCK is not defined.
+// Returns a range over the lines a string would be split into by vector_split(), produced one at a time as views into the original string.
+LineRange split_lines(std::string_view text, unsigned int line_len)
+{
+	return LineRange(text, line_len);
+}
+
+// As string_explode(), but returns offset/length pairs into the original string rather than copying each part.
+std::vector<Slice> string_explode_slices(std::string_view str, std::string_view separator)
+{
+	stack_trace();
+	std::vector<Slice> results;
+	size_t start = 0;
+	if (separator.size())
+	{
+		size_t pos;
+		while ((pos = unc::find_separator(str.data(), str.size(), start, separator.data(), separator.size())) != std::string::npos)
+		{
+			results.push_back({start, pos - start});
+			start = pos + separator.size();
+		}
+	}
+	results.push_back({start, str.size() - start});
+	return results;
+}
 
-// String split/explode function.
-std::vector<std::string> string_explode(std::string str, std::string separator)
+// As vector_split(), but returns offset/length pairs into the original string rather than copying each line.
+std::vector<Slice> vector_split_slices(std::string_view source, unsigned int line_len)
 {
 	stack_trace();
-	std::vector<std::string> results;
+	std::vector<Slice> result;
+	for (auto line : unc::split_lines(source, line_len))
+		result.push_back({static_cast<size_t>(line.data() - source.data()), line.size()});
+	return result;
+}
 
-	std::string::size_type pos = str.find(separator, 0);
-	const int pit = separator.length();
+// Returns the current size and hit/miss counts of the word-wrap layout cache.
+WrapCacheStats wrap_cache_stats()
+{
+	stack_trace();
+	WrapCacheStats stats;
+	stats.entries = wrap_cache.size();
+	stats.hits = wrap_cache_hits;
+	stats.max_entries = wrap_cache_max;
+	stats.misses = wrap_cache_misses;
+	return stats;
+}
 
-	while(pos != std::string::npos)
-	{
-		if (pos == 0) results.push_back("");
-		else results.push_back(str.substr(0, pos));
-        str.erase(0, pos + pit);
-        pos = str.find(separator, 0);
-    }
-    results.push_back(str);
+// Below this point are versions of functions from the Potluck library. These are built on the slice functions above, and are used whether or not USING_POTLUCK is defined,
+// so the source string is only copied once per part or line.
 
-    return results;
+// String split/explode function.
+std::vector<std::string> string_explode(std::string_view str, std::string_view separator)
+{
+	stack_trace();
+	std::vector<std::string> results;
+	for (auto slice : unc::string_explode_slices(str, separator))
+		results.push_back(std::string(str.substr(slice.offset, slice.length)));
+	return results;
 }
 
 // Splits a string into a vector of strings, to a given line length.
-std::vector<std::string> vector_split(std::string source, unsigned int line_len)
+std::vector<std::string> vector_split(std::string_view source, unsigned int line_len)
 {
 	stack_trace();
 	std::vector<std::string> result;
-	if (source.size() <= line_len)
-	{
-		result.push_back(source);
-		return result;
-	}
-	std::vector<std::string> words = unc::string_explode(source, " ");
-	std::string current_line;
-	while (words.size())
-	{
-		std::string word = words.at(0);
-		words.erase(words.begin());
-		if (word.size() > line_len)
-		{
-			// If the word itself is too long for the line, break it into two, then deal with them individually.
-			// We'll then deal with that in the normal way afterwards. If the second half is still too long, it'll get broken up again when we get to it.
-			// This could result in more iteration for edge cases, but overall keeps the code nice and simple.
-			std::string first_half = word.substr(0, line_len);
-			std::string second_half = word.substr(line_len + 1);
-			words.insert(words.begin(), second_half);
-			words.insert(words.begin(), first_half);
-			continue;
-		}
-		if (current_line.size() + word.size() + 1 > line_len)
-		{
-			result.push_back(current_line);
-			current_line = word;
-			continue;
-		}
-		if (current_line.size()) current_line += " " + word;
-		else current_line = word;
-	}
-	if (current_line.size()) result.push_back(current_line);
+	for (auto slice : unc::vector_split_slices(source, line_len))
+		result.push_back(std::string(source.substr(slice.offset, slice.length)));
 	return result;
 }
-#else
-std::vector<std::string> string_explode(std::string str, std::string separator) { return potluck::string_explode(str, separator); }
-std::vector<std::string> vector_split(std::string source, unsigned int line_len) { return potluck::vector_split(source, line_len); }
-#endif
 
 }	// namespace unc
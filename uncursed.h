@@ -27,8 +27,13 @@ SOFTWARE.
 #pragma once
 
 
+#include <cstddef>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace unc
@@ -53,6 +58,12 @@ typedef struct panel PANEL;
 
 enum class Colour : unsigned int { NONE, BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE, BLACK_BOLD, RED_BOLD, GREEN_BOLD, YELLOW_BOLD, BLUE_BOLD, MAGENTA_BOLD, CYAN_BOLD, WHITE_BOLD };
 
+// NATIVE sends the screen to the terminal through curses as usual. ANSI still composes the screen with curses, but diffs it against the previous frame itself and writes minimal ANSI escape sequences
+// straight to the terminal, which is considerably cheaper on busy screens. HEADLESS composes the screen in memory only, with no terminal needed at all; keys come from queue_key() and queue_keys(),
+// the size from set_headless_size(), and the composed screen can be read back with screen_cell() and screen_text(). ANSI and HEADLESS need NCurses with wide character support (and ANSI needs
+// a terminal on stdin/stdout). Without them, init() falls back to NATIVE for ANSI, but throws for HEADLESS rather than start on a real terminal, and screen_cell() and screen_text() throw.
+enum class Backend : unsigned int { NATIVE, ANSI, HEADLESS };
+
 enum class Glyph : unsigned int { ULCORNER = 256, LLCORNER, URCORNER, LRCORNER, RTEE, LTEE, BTEE, TTEE, HLINE, VLINE, PLUS, S1, S9, DIAMOND, CKBOARD, DEGREE, PLMINUS, BULLET, LARROW, RARROW, DARROW, UARROW, BOARD, LANTERN, BLOCK,
 	S3, S7, LEQUAL, GEQUAL, PI, NEQUAL, STERLING };
 
@@ -63,6 +74,8 @@ enum class Glyph : unsigned int { ULCORNER = 256, LLCORNER, URCORNER, LRCORNER,
 #define UNC_DOUBLE	16	// Renders a char twice, side-by-side.
 #define UNC_BLINK	32	// Blinking colour effect.
 
+class WindowRef;	// defined below
+
 class Window
 {
 public:
@@ -71,32 +84,295 @@ public:
 	unsigned int	get_height() const { return h; }	// Read-only access to the Window's height.
 	unsigned int	get_width() const { return w; }		// Read-only access to the Window's width.
 	void			redraw_border(unc::Colour col = unc::Colour::NONE);	// Re-renders the border around this Window, if any.
+	void			clear_chrome();						// Forgets this Window's chrome template, if it has one.
+	bool			restore_chrome();					// Restores this Window's contents from its chrome template, or returns false if there isn't one.
+	void			save_chrome();						// Saves this Window's current contents (border, title, other static decorations) as its chrome template.
+	void			copy_rect(unc::WindowRef dest, int src_x, int src_y, int width, int height, int dest_x, int dest_y, bool overlay = false) const;	// Copies part of this Window into another.
+	void			overlay_onto(unc::WindowRef dest, int dest_x = 0, int dest_y = 0) const;	// Copies this Window into another, with blank cells left transparent.
+	void			overwrite_onto(unc::WindowRef dest, int dest_x = 0, int dest_y = 0) const;	// Copies this Window into another, blank cells included.
 	void			set_visible(bool vis);				// Set this Window's panel as visible or invisible.
 	void			move(int new_x, int new_y);			// Moves this Window's underlying panel to new coordinates.
-	WINDOW*			win() const { return window_ptr; }	// Returns a pointer to the WINDOW struct.
+	bool			is_occluded() const { return occluded; }	// Is this Window completely covered by other Windows above it? If so, drawing into it can be skipped.
+	void			lower();							// Moves this Window beneath all other Windows.
+	void			raise();							// Moves this Window above all other Windows.
+	WINDOW*			win() const { return window_ptr; }	// Returns a pointer to the WINDOW struct. print() and box() leave their style set on it, so set its attributes before drawing on it directly.
 
 private:
 	std::shared_ptr<unc::Window>	border_ptr;	// If a border is present, this is the underlying border Window.
+	WINDOW*			chrome_ptr;	// The chrome template saved by save_chrome(), or nullptr if there isn't one.
+	bool			occluded;	// Is this Window completely covered by other Windows above it? Kept up to date by update_occlusion().
 	PANEL*			panel_ptr;	// A pointer to the underlying PANEL struct.
+	std::vector<unsigned long long>	row_hashes;	// Hashes of each row's contents at the last flip(), used to skip unchanged rows.
 	unsigned int	w, h;		// The width and height of this Window.
 	WINDOW*			window_ptr;	// A pointer to the underlying WINDOW struct.
 	int				x, y;		// The screen coordinates of this Window.
+
+	friend void		present_frame();
+	friend void		update_occlusion(int area_x, int area_y, int area_w, int area_h);
+};
+
+// Markup is text with inline style tags, such as "{R}Danger{/} {Gb}ok{/}". A tag is an optional colour letter (K, R, G, Y, B, M, C or W, for black through white), followed by
+// any of the lowercase flags b (bold), r (reverse) and f (flashing/blink). Each tag replaces the current style entirely, {/} returns to the default style, and {{ prints a literal brace.
+struct StyleRun
+{
+	unsigned long	attr;			// The curses attributes (colour pair, bold, etc.) used for this run.
+	size_t			offset, length;	// The position of this run in the Markup's plain text.
+};
+
+class Markup
+{
+public:
+	explicit						Markup(std::string_view source);	// Compiles text with inline style tags into plain text and a list of styled runs.
+	const std::vector<StyleRun>&	runs() const { return style_runs; }	// The styled runs, which cover the whole of the plain text, in order.
+	const std::string&				text() const { return plain_text; }	// The text with all the style tags removed.
+
+private:
+	std::string				plain_text;	// The text with all the style tags removed.
+	std::vector<StyleRun>	style_runs;	// The styled runs, which cover the whole of the plain text, in order.
+
+	void	add_text(std::string_view text, unsigned long attr);	// Adds plain text to the end of this Markup, in the given style.
+};
+
+// StaticMarkup uses the same tag syntax as Markup, plus {#NAME} to embed a Glyph (for example {#DIAMOND}), but is compiled at compile time by static_markup().
+// Invalid markup is a compile error when the result is assigned to a constexpr variable, e.g. static constexpr auto title = unc::static_markup("{Cb}Inventory{/} {#BULLET}");
+struct StaticRun
+{
+	Colour			colour;			// The colour used for this run.
+	unsigned int	flags;			// The UNC_* flags used for this run.
+	size_t			offset, length;	// The position of this run in the StaticMarkup's cells.
+};
+
+template <size_t N> struct StaticMarkup
+{
+	unsigned int	cells[N] = {};	// Characters, or unc::Glyph values for embedded glyphs.
+	size_t			cell_count = 0;	// The number of cells actually used.
+	StaticRun		runs[N] = {};	// The styled runs, which cover all of the cells, in order.
+	size_t			run_count = 0;	// The number of runs actually used.
+};
+
+constexpr const char* glyph_names[] = { "ULCORNER", "LLCORNER", "URCORNER", "LRCORNER", "RTEE", "LTEE", "BTEE", "TTEE", "HLINE", "VLINE", "PLUS", "S1", "S9", "DIAMOND", "CKBOARD", "DEGREE",
+	"PLMINUS", "BULLET", "LARROW", "RARROW", "DARROW", "UARROW", "BOARD", "LANTERN", "BLOCK", "S3", "S7", "LEQUAL", "GEQUAL", "PI", "NEQUAL", "STERLING" };	// Names for {#NAME} glyph tags, in Glyph order.
+static_assert(sizeof(glyph_names) / sizeof(glyph_names[0]) == static_cast<unsigned int>(Glyph::STERLING) - static_cast<unsigned int>(Glyph::ULCORNER) + 1, "glyph_names must match the Glyph enum.");
+
+// Compiles markup into a StaticMarkup at compile time. Throws (which is a compile error in a constant expression) if the markup is invalid.
+template <size_t N> constexpr StaticMarkup<N> static_markup(const char (&source)[N])
+{
+	StaticMarkup<N> result;
+	Colour colour = Colour::NONE;
+	unsigned int flags = 0;
+	auto add_cell = [&result, &colour, &flags](unsigned int cell) {
+		if (!result.run_count || result.runs[result.run_count - 1].colour != colour || result.runs[result.run_count - 1].flags != flags)
+			result.runs[result.run_count++] = StaticRun{colour, flags, result.cell_count, 0};
+		result.cells[result.cell_count++] = cell;
+		result.runs[result.run_count - 1].length++;
+	};
+
+	const size_t len = N - 1;
+	size_t pos = 0;
+	while (pos < len)
+	{
+		if (source[pos] != '{')
+		{
+			add_cell(static_cast<unsigned char>(source[pos++]));
+			continue;
+		}
+		if (pos + 1 < len && source[pos + 1] == '{')
+		{
+			add_cell('{');
+			pos += 2;
+			continue;
+		}
+		size_t tag_end = pos + 1;
+		while (tag_end < len && source[tag_end] != '}') tag_end++;
+		if (tag_end == len) throw std::logic_error("Unterminated markup tag.");
+		const char *tag = source + pos + 1;
+		const size_t tag_len = tag_end - pos - 1;
+		pos = tag_end + 1;
+
+		if (tag_len == 1 && tag[0] == '/')
+		{
+			colour = Colour::NONE;
+			flags = 0;
+			continue;
+		}
+		if (tag_len > 1 && tag[0] == '#')
+		{
+			unsigned int glyph = 0;
+			for (unsigned int g = 0; g < sizeof(glyph_names) / sizeof(glyph_names[0]) && !glyph; g++)
+			{
+				size_t i = 0;
+				while (i < tag_len - 1 && glyph_names[g][i] && glyph_names[g][i] == tag[i + 1]) i++;
+				if (i == tag_len - 1 && !glyph_names[g][i]) glyph = static_cast<unsigned int>(Glyph::ULCORNER) + g;
+			}
+			if (!glyph) throw std::logic_error("Unknown glyph name in markup.");
+			add_cell(glyph);
+			continue;
+		}
+		if (!tag_len) throw std::logic_error("Empty markup tag.");
+		colour = Colour::NONE;
+		flags = 0;
+		size_t i = 0;
+		switch (tag[0])
+		{
+			case 'K': colour = Colour::BLACK; break;
+			case 'R': colour = Colour::RED; break;
+			case 'G': colour = Colour::GREEN; break;
+			case 'Y': colour = Colour::YELLOW; break;
+			case 'B': colour = Colour::BLUE; break;
+			case 'M': colour = Colour::MAGENTA; break;
+			case 'C': colour = Colour::CYAN; break;
+			case 'W': colour = Colour::WHITE; break;
+		}
+		if (colour != Colour::NONE) i++;
+		for (; i < tag_len; i++)
+		{
+			if (tag[i] == 'b') flags |= UNC_BOLD;
+			else if (tag[i] == 'f') flags |= UNC_BLINK;
+			else if (tag[i] == 'r') flags |= UNC_REVERSE;
+			else throw std::logic_error("Invalid markup tag.");
+		}
+	}
+	return result;
+}
+
+class WindowRef	// A non-owning reference to a Window (or the main screen, if empty), so drawing calls don't have to copy shared_ptrs around.
+{
+public:
+				WindowRef(std::nullptr_t = nullptr) : window_ptr(nullptr) { }
+				WindowRef(Window &window) : window_ptr(&window) { }
+				WindowRef(Window *window) : window_ptr(window) { }
+				WindowRef(const std::shared_ptr<Window> &window) : window_ptr(window.get()) { }
+	Window*		get() const { return window_ptr; }	// Returns the Window being referred to, or nullptr for the main screen.
+	explicit	operator bool() const { return window_ptr != nullptr; }
+	Window&		operator*() const { return *window_ptr; }
+	Window*		operator->() const { return window_ptr; }
+
+private:
+	Window*		window_ptr;	// The Window being referred to, or nullptr for the main screen.
 };
 
-void			box(std::shared_ptr<unc::Window> window = nullptr, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0);	// Draws a box around the edge of a Window.
-void			clear_line(std::shared_ptr<unc::Window> window = nullptr);	// Clears the current line.
-void			cls(std::shared_ptr<unc::Window> window = nullptr);		// Clears the screen.
-void			flip();		// Refreshes the screen.
+// A single pre-styled cell for blit(), built with make_cell() so its colour and flags are only resolved into curses attributes once, rather than every time it's drawn.
+struct Cell
+{
+	unsigned long	attr;		// The cell's curses attributes (colour pair, bold, etc.).
+	unsigned int	glyph;		// The character to draw (a Unicode code point, with wide character support), or a unc::Glyph if is_glyph is set.
+	bool			is_glyph;	// Whether glyph is a unc::Glyph rather than a character.
+};
+
+struct FrameStats
+{
+	unsigned long long	attr_changes_saved;	// Style changes print() and box() didn't have to make, because the Window was already in that style.
+	unsigned long long	bytes_written;	// Bytes sent to the terminal by the ANSI backend.
+	unsigned long long	flip_ns;		// Total time spent presenting frames, in nanoseconds.
+	unsigned long long	frames_collapsed;	// Frames the ANSI writer thread fell too far behind to send, which were merged into the frame after them instead.
+	unsigned long long	frames_degraded;	// Frames sent at less than full quality, because the terminal wasn't keeping up (see set_adaptive_quality()).
+	unsigned long long	frames_presented;	// The number of frames actually sent to the terminal.
+	unsigned long long	frames_requested;	// The number of times flip() or flip_now() has been called.
+	unsigned long long	quality_changes;	// The number of times the adaptive quality level has gone up or down.
+	unsigned long long	rows_emitted;	// Rows passed on to curses at flip() time, because they changed (or row skipping is disabled).
+	unsigned long long	rows_skipped;	// Rows that were unchanged since the last flip(), so curses didn't have to look at them.
+	unsigned long long	windows_occluded;	// Windows left alone at flip() time because they were completely covered by other Windows.
+	unsigned long long	windows_refreshed;	// Windows passed on to curses at flip() time, because they'd been drawn into or something below them had.
+	unsigned long long	windows_skipped;	// Windows left alone at flip() time, because nothing about them had changed.
+	unsigned long long	write_calls;	// write() calls made by the ANSI backend. Each frame is sent with one, unless the terminal only accepts part of it at a time.
+	unsigned long long	write_ns;		// Time the ANSI backend spent blocked writing to the terminal, in nanoseconds; with threaded output this is the writer thread's time, not flip()'s.
+};
+
+struct ScreenCell
+{
+	Colour			colour;	// The cell's colour. Bold colours read back as the plain colour, with UNC_BOLD set in flags.
+	unsigned int	flags;	// Any of UNC_BOLD, UNC_REVERSE and UNC_BLINK.
+	std::string		text;	// The cell's character (and any combining characters), as UTF-8. Line-drawing characters are converted to their Unicode equivalents.
+};
+
+struct Slice
+{
+	size_t	offset, length;	// A section of a string, as an offset and length into the original.
+};
+
+class LineRange	// A range over the lines vector_split() would produce, worked out one at a time as they're needed.
+{
+public:
+	class iterator
+	{
+	public:
+		typedef std::forward_iterator_tag	iterator_category;
+		typedef std::ptrdiff_t				difference_type;
+		typedef const std::string_view*		pointer;
+		typedef const std::string_view&		reference;
+		typedef std::string_view			value_type;
+
+					iterator() : ascii(true), current_cols(0), current_line{0, 0}, done(true), index(0), line_len(0), word{0, 0}, word_cols(0), word_pending(false), word_start(0), words_done(true) { }	// An end iterator.
+					iterator(std::string_view new_text, unsigned int new_line_len);
+		reference	operator*() const { return line; }
+		pointer		operator->() const { return &line; }
+		iterator&	operator++() { next(); return *this; }
+		iterator	operator++(int) { iterator old = *this; next(); return old; }
+		bool		operator==(const iterator &other) const { return done == other.done && (done || index == other.index); }
+		bool		operator!=(const iterator &other) const { return !(*this == other); }
+
+	private:
+		bool				ascii;			// Is the text pure ASCII? If not, widths are measured as UTF-8.
+		size_t				current_cols;	// The display width of the line currently being built.
+		Slice				current_line;	// The line currently being built.
+		bool				done;			// Set when there are no more lines.
+		unsigned int		index;			// How many lines have been produced so far.
+		std::string_view	line;			// The current line.
+		unsigned int		line_len;		// The maximum line length.
+		std::string_view	text;			// The text being split.
+		Slice				word;			// The word (or what's left of it) waiting to be added to a line.
+		size_t				word_cols;		// The display width of the waiting word.
+		bool				word_pending;	// Is there a word waiting to be added to a line?
+		size_t				word_start;		// Where the next word starts.
+		bool				words_done;		// Set when the last word has been read.
+
+		void	next();	// Moves on to the next line, following the same rules as vector_split(), but measuring UTF-8 text by display width.
+	};
+
+				LineRange(std::string_view new_text, unsigned int new_line_len) : line_len(new_line_len), text(new_text) { }
+	iterator	begin() const { return iterator(text, line_len); }
+	iterator	end() const { return iterator(); }
+
+private:
+	unsigned int		line_len;	// The maximum line length.
+	std::string_view	text;		// The text being split.
+};
+
+struct TextMetrics
+{
+	unsigned int	rows;		// The number of rows the text takes up, including the row it starts on.
+	unsigned int	end_col;	// The cursor column after the text is printed.
+	unsigned int	widest;		// The furthest column any line of the text reaches.
+};
+
+struct WrapCacheStats
+{
+	unsigned int		entries;		// The number of layouts currently held in the wrap cache.
+	unsigned long long	hits, misses;	// How many times print() found, or failed to find, a layout in the cache.
+	unsigned int		max_entries;	// The maximum number of layouts the cache can hold.
+};
+
+unsigned int	add_resize_callback(std::function<void(unsigned int cols, unsigned int rows)> callback);	// Registers a function to be called with the new width and height whenever the screen is resized.
+void			blit(const Cell *cells, size_t cell_count, unsigned int stride, unsigned int w, unsigned int h, int x, int y, unc::WindowRef window = nullptr);	// Draws a block of pre-styled cells, clipped to the Window.
+void			box(unc::WindowRef window = nullptr, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0);	// Draws a box around the edge of a Window, leaving its style set on the Window afterwards (as print() does).
+void			clear_line(unc::WindowRef window = nullptr);	// Clears the current line.
+void			clear_wrap_cache();	// Empties the word-wrap layout cache and resets its statistics.
+void			cls(unc::WindowRef window = nullptr, bool full_repaint = false);	// Clears the screen, or a Window. With full_repaint set, the whole terminal is also redrawn from scratch at the next flip().
+unsigned int	count_lines(std::string_view text, unsigned int line_len);	// Counts the lines a string would be split into by vector_split(), without building them.
+unsigned int	display_width(std::string_view text);	// Measures the display width of a string in columns, allowing for UTF-8 wide and zero-width characters.
+void			flip();		// Refreshes the screen. With a frame rate limit set, this may only mark the screen as needing a refresh, which then happens on a later flip() or get_key().
+void			flip_now();	// Refreshes the screen immediately, regardless of any frame rate limit.
 void			flush();	// Flushes the input buffer.
-unsigned int	get_cols(std::shared_ptr<unc::Window> window = nullptr);		// Gets the number of columns available on the screen right now.
-unsigned int	get_cursor_x(std::shared_ptr<unc::Window> window = nullptr);	// Gets the current cursor X coordinate.
-unsigned int	get_cursor_y(std::shared_ptr<unc::Window> window = nullptr);	// Gets the current cursor Y coordinate.
-int				get_key(std::shared_ptr<unc::Window> window = nullptr);		// Gets a keypress as input.
-unsigned int	get_midcol(std::shared_ptr<unc::Window> window = nullptr);		// Gets the central column of the specified Window.
-unsigned int	get_midrow(std::shared_ptr<unc::Window> window = nullptr);		// Gets the central row of the specified Window.
-unsigned int	get_rows(std::shared_ptr<unc::Window> window = nullptr);		// Gets the number of rows available on the screen right now.
-std::string		get_string(std::shared_ptr<unc::Window> window = nullptr);		// C++ std::string wrapper around the PDCurses wgetnstr() function.
-void			init(std::string syslog_filename = "");	// Sets up Curses.
+FrameStats		frame_stats();	// Returns the frame statistics gathered since the last reset_frame_stats().
+unsigned int	get_cols(unc::WindowRef window = nullptr);		// Gets the number of columns available on the screen right now.
+unsigned int	get_cursor_x(unc::WindowRef window = nullptr);	// Gets the current cursor X coordinate.
+unsigned int	get_cursor_y(unc::WindowRef window = nullptr);	// Gets the current cursor Y coordinate.
+int				get_key(unc::WindowRef window = nullptr);		// Gets a keypress as input, or the next key from the queue with the headless backend.
+unsigned int	get_midcol(unc::WindowRef window = nullptr);		// Gets the central column of the specified Window.
+unsigned int	get_midrow(unc::WindowRef window = nullptr);		// Gets the central row of the specified Window.
+unsigned int	get_rows(unc::WindowRef window = nullptr);		// Gets the number of rows available on the screen right now.
+std::string		get_string(unc::WindowRef window = nullptr);		// C++ std::string wrapper around the PDCurses wgetnstr() function.
+void			init(std::string syslog_filename = "", Backend backend = Backend::NATIVE);	// Sets up Curses, using the specified output backend.
 void			init_colours();		// Sets up the Curses colour pairs.
 bool			is_cancel(int key);	// Checks if a key is a cancel key (escape).
 bool			is_down(int key);	// Checks if a key is the down arrow key.
@@ -104,26 +380,58 @@ bool			is_left(int key);	// Checks if a key is the left arrow key.
 bool			is_right(int key);	// Checks if a key is the right arrow key.
 bool			is_select(int key);	// Checks if a key is a select key (space bar or enter).
 bool			is_up(int key);		// Checks if a key is the up arrow key.
-void			move_cursor(int x, int y, std::shared_ptr<unc::Window> window = nullptr);	// Moves the cursor to the given coordinates; -1 for either coordinate retains its current position on that axis.
-				// Prints a string on the screen, with optional word-wrap.
-Colour			parse_colour(std::string input);	// Parses a string into a Colour, or Colour::NONE if it could not be parsed.
-unsigned int	parse_flags(std::string input);		// Parses a string into flags (such as UNC_BOLD | UNC_REVERSE), or 0 if nothing could be parsed from the string.
-void			print(std::string input, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, std::shared_ptr<unc::Window> window = nullptr);
-void			print(int input = '\n', unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, std::shared_ptr<unc::Window> window = nullptr);	// As above, but for a single character.
-void			print(unc::Glyph input, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, std::shared_ptr<unc::Window> window = nullptr);	// Simple wrapper for high-ASCII glyphs.
-void			print(std::shared_ptr<unc::Window> window, int newline_count = 1);	// This just makes it easier to do a newline print() on a Window.
-void			render_grid(int x, int y, int w, int h, unc::Colour colour = unc::Colour::NONE, std::shared_ptr<unc::Window> window = nullptr);	// Renders a grid of the specified size.
+FrameStats		last_frame_stats();	// Returns the frame statistics for the most recently presented frame alone.
+Cell			make_cell(unsigned int glyph, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0);	// Builds a Cell for blit(), resolving its colour and flags into curses attributes. The glyph is always taken as a character.
+Cell			make_cell(unc::Glyph glyph, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0);	// As above, but for a unc::Glyph.
+const Markup&	markup(std::string_view source);	// Returns a compiled Markup for the given text, compiling it only the first time it's seen.
+TextMetrics		measure(std::string_view text, unsigned int width, unsigned int start_col = 0);	// Works out how text would be laid out by print(), without drawing anything.
+void			move_cursor(int x, int y, unc::WindowRef window = nullptr);	// Moves the cursor to the given coordinates; -1 for either coordinate retains its current position on that axis.
+				// Prints a string on the screen, with optional word-wrap. The style is left set on the Window afterwards, so the next print() in the same style has nothing to change.
+Colour			parse_colour(std::string_view input);	// Parses a string into a Colour, or Colour::NONE if it could not be parsed.
+unsigned int	parse_flags(std::string_view input);		// Parses a string into flags (such as UNC_BOLD | UNC_REVERSE), or 0 if nothing could be parsed from the string.
+void			print(std::string_view input, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, unc::WindowRef window = nullptr);
+void			print(const char *input, size_t length, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, unc::WindowRef window = nullptr);	// As above, but for a string that isn't null-terminated.
+void			print(const Markup &input, unsigned int flags = 0, int x = -1, int y = -1, unc::WindowRef window = nullptr);	// As above, but for text with inline style tags, compiled into a Markup.
+template <size_t N> void print(const StaticMarkup<N> &input, unsigned int flags = 0, int x = -1, int y = -1, unc::WindowRef window = nullptr);	// As above, but for markup compiled at compile time by static_markup(). Printed as-is, without word-wrap.
+void			print(int input = '\n', unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, unc::WindowRef window = nullptr);	// As above, but for a single character.
+void			print(unc::Glyph input, unc::Colour colour = unc::Colour::NONE, unsigned int flags = 0, int x = -1, int y = -1, unc::WindowRef window = nullptr);	// Simple wrapper for high-ASCII glyphs.
+void			print(unc::WindowRef window, int newline_count = 1);	// This just makes it easier to do a newline print() on a Window.
+void			print_cells(const unsigned int *cells, size_t cell_count, const StaticRun *runs, size_t run_count, unsigned int flags, int x, int y, unc::WindowRef window);	// Prints a StaticMarkup's pre-resolved cells.
+void			queue_key(int key);	// Adds a key to the end of the headless backend's key queue.
+void			queue_keys(std::string_view keys);	// Adds each character of a string to the end of the headless backend's key queue.
+unsigned int	quality_level();	// Returns the current adaptive quality level: 0 is full quality, and each level above that degrades output further (see set_adaptive_quality()).
+void			remove_resize_callback(unsigned int id);	// Removes a function registered with add_resize_callback().
+void			render_grid(int x, int y, int w, int h, unc::Colour colour = unc::Colour::NONE, unc::WindowRef window = nullptr);	// Renders a grid of the specified size.
 int				resize_key();	// Access to the KEY_RESIZE definition in curses.h
+void			reset_frame_stats();	// Resets the frame statistics to zero.
+ScreenCell		screen_cell(unsigned int x, unsigned int y);	// Reads back a single cell of the screen, as composed at the last flip().
+std::vector<std::string>	screen_text();	// Reads back the text on the screen as composed at the last flip(), one string per row.
+void			set_adaptive_quality(bool enabled);	// Lowers the ANSI backend's output quality when the terminal can't keep up, and restores it when the terminal recovers.
 void			set_cursor(bool enabled);	// Turns the cursor on or off.
+void			set_frame_rate_limit(unsigned int frames_per_second);	// Limits how often flip() actually sends the screen to the terminal (0 removes the limit).
+void			set_headless_size(unsigned int cols, unsigned int rows);	// Sets the size of the headless backend's screen. Any size from 1x1 up is allowed; the 80x24 minimum only applies to real terminals.
 #ifdef PDCURSES
-void			set_window_title(std::string title);	// Sets the console window title. Only works on PDCurses; does nothing on NCurses.
+void			set_window_title(std::string_view title);	// Sets the console window title. Only works on PDCurses; does nothing on NCurses.
 #else
-void			set_window_title(std::string);
+void			set_window_title(std::string_view);
 #endif
+void			set_wrap_cache(unsigned int max_entries);	// Enables caching of word-wrap layouts for print(), up to the given number of layouts (0 disables the cache).
+void			set_row_skipping(bool enabled);	// Enables skipping of unchanged rows at flip() time, by comparing a hash of each row against the last frame.
+void			set_threaded_output(bool enabled);	// Sends frames to the terminal from a separate thread when the ANSI backend is active, so a slow terminal doesn't hold up flip().
 void			shutdown();	// Runs Curses cleanup code.
+LineRange		split_lines(std::string_view text, unsigned int line_len);	// Returns a range over the lines a string would be split into by vector_split(), produced one at a time as views into the original string.
+std::vector<Slice>	string_explode_slices(std::string_view str, std::string_view separator);	// As string_explode(), but returns offset/length pairs into the original string rather than copying each part.
+std::vector<Slice>	vector_split_slices(std::string_view source, unsigned int line_len);	// As vector_split(), but returns offset/length pairs into the original string rather than copying each line.
+WrapCacheStats	wrap_cache_stats();	// Returns the current size and hit/miss counts of the word-wrap layout cache.
+
+// Versions of functions from the Potluck library, built on string_explode_slices() and vector_split_slices(); these don't call Potluck even when USING_POTLUCK is defined.
+std::vector<std::string>	string_explode(std::string_view str, std::string_view separator);		// String split/explode function.
+std::vector<std::string>	vector_split(std::string_view source, unsigned int line_len);	// Splits a string into a vector of strings, to a given line length.
 
-// Replacement functions provided by the Potluck library.
-std::vector<std::string>	string_explode(std::string str, std::string separator);		// String split/explode function.
-std::vector<std::string>	vector_split(std::string source, unsigned int line_len);	// Splits a string into a vector of strings, to a given line length.
+// As above, but for markup compiled at compile time by static_markup(). Printed as-is, without word-wrap.
+template <size_t N> void print(const StaticMarkup<N> &input, unsigned int flags, int x, int y, unc::WindowRef window)
+{
+	unc::print_cells(input.cells, input.cell_count, input.runs, input.run_count, flags, x, y, window);
+}
 
 }	// namespace unc